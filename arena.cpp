@@ -0,0 +1,45 @@
+#include "arena.h"
+
+/*!
+    Returns bytes of memory aligned to align. Moves on to the next kept
+    block (or a new one) when the current block is full; requests larger
+    than a block get a block of their own.
+*/
+void* Arena::allocate(qsizetype bytes, qsizetype align) {
+    while (__block >= 0) {
+        qsizetype start = (__block_used + align - 1) & ~(align - 1);
+        if (start + bytes <= __blocks[__block].size) {
+            __block_used = start + bytes;
+            __used += bytes;
+            return __blocks[__block].data.get() + start;
+        }
+
+        if (__block + 1 == (qsizetype)__blocks.size())
+            break;
+        __block++;
+        __block_used = 0;
+    }
+
+    qsizetype size = qMax(block_size, bytes + align);
+    __blocks.push_back({std::unique_ptr<char[]>(new char[size]), size});
+    __block = (qsizetype)__blocks.size() - 1;
+    __block_used = 0;
+
+    return allocate(bytes, align);
+}
+
+/*!
+    Forgets every allocation at once.
+*/
+void Arena::reset() {
+    __block = __blocks.empty() ? -1 : 0;
+    __block_used = 0;
+    __used = 0;
+}
+
+qsizetype Arena::capacity() const {
+    qsizetype total = 0;
+    for (const Block& block : __blocks)
+        total += block.size;
+    return total;
+}
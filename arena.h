@@ -0,0 +1,50 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <QtGlobal>
+
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+/*!
+    Bump-pointer allocator for objects that live as long as one compile.
+    Allocation moves a pointer inside the current block; nothing is freed
+    one by one. reset() rewinds to the first block and keeps the memory,
+    so the next compile allocates nothing until it outgrows the last one.
+*/
+class Arena {
+    struct Block {
+        std::unique_ptr<char[]> data;
+        qsizetype size;
+    };
+
+    static constexpr qsizetype block_size = 64 * 1024;
+
+    std::vector<Block> __blocks;
+    qsizetype __block = -1;
+    qsizetype __block_used = 0;
+    qsizetype __used = 0;
+
+public:
+    Arena() = default;
+
+    void* allocate(qsizetype bytes, qsizetype align);
+
+    /*!
+        Returns uninitialised room for count objects of T.
+    */
+    template <typename T>
+    T* allocate(qsizetype count) {
+        static_assert(std::is_trivially_destructible_v<T>,
+                      "Arena never runs destructors");
+        return static_cast<T*>(allocate(count * (qsizetype)sizeof(T), alignof(T)));
+    }
+
+    void reset();
+
+    qsizetype used() const { return __used; }
+    qsizetype capacity() const;
+};
+
+#endif // ARENA_H
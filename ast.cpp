@@ -0,0 +1,198 @@
+#include "ast.h"
+
+#include <algorithm>
+#include <cstring>
+
+/*!
+    Drops the tree; all nodes go with a single arena reset.
+*/
+void Ast::clear() {
+    __arena.reset();
+    __post_order = nullptr;
+    __post_size = 0;
+    __post_capacity = 0;
+    __nodes = nullptr;
+    __size = 0;
+    __capacity = 0;
+    __tokens = 0;
+}
+
+/*!
+    Every token is at most one leaf and one unit reduction, and every other
+    reduction consumes at least one more symbol than it produces, so
+    3 * tokens nodes are always enough.
+*/
+void Ast::reserve(qsizetype tokens) {
+    reserve_post_order(3 * tokens + 4);
+}
+
+/*!
+    Makes room for nodes nodes in post order, moving the ones already
+    there to a bigger region of the arena if needed.
+*/
+void Ast::reserve_post_order(qsizetype nodes) {
+    if (nodes <= __post_capacity)
+        return;
+
+    AstNode* post_order = __arena.allocate<AstNode>(nodes);
+    std::copy(__post_order, __post_order + __post_size, post_order);
+    __post_order = post_order;
+    __post_capacity = nodes;
+}
+
+AstNode& Ast::emit() {
+    if (Q_UNLIKELY(__post_size == __post_capacity))
+        reserve_post_order(2 * __post_capacity + 64);
+    return __post_order[__post_size++];
+}
+
+void Ast::add_leaf(qint32 token) {
+    emit() = {1, token, token, -1, 0, RuleType::ID};
+}
+
+/*!
+    Adds a node over the last children subtrees added.
+*/
+void Ast::add_node(qint16 rule, RuleType type, quint16 children, qint32 first, qint32 last) {
+    quint32 size = 1;
+    qsizetype child = __post_size - 1;
+
+    for (quint16 i = 0; i < children; i++) {
+        size += __post_order[child].size;
+        child -= __post_order[child].size;
+    }
+
+    emit() = {size, first, last, rule, children, type};
+}
+
+/*!
+    Lays the nodes in post order out in pre order. Going from the end of
+    the post order, parents come before their children, so each node gets
+    its place from its parent's: the last child ends where the parent's
+    subtree ends, and every earlier child ends where the next one starts.
+*/
+void Ast::layout(AstNode* out) {
+    const qsizetype n = __post_size;
+    quint32* positions = __arena.allocate<quint32>(n);
+
+    qsizetype end = n;
+    for (qsizetype root = n - 1; root >= 0; root -= __post_order[root].size) {
+        positions[root] = (quint32)(end - __post_order[root].size);
+        end = positions[root];
+    }
+
+    for (qsizetype node = n - 1; node >= 0; node--) {
+        const AstNode& parent = __post_order[node];
+        end = positions[node] + parent.size;
+
+        for (qsizetype child = node - 1; child > node - (qsizetype)parent.size;
+             child -= __post_order[child].size) {
+            positions[child] = (quint32)(end - __post_order[child].size);
+            end = positions[child];
+        }
+
+        out[positions[node]] = parent;
+    }
+}
+
+void Ast::finish(qsizetype tokens) {
+    const qsizetype size = __post_size;
+    AstNode* nodes = __arena.allocate<AstNode>(size + size / 8);
+    layout(nodes);
+
+    __nodes = nodes;
+    __size = size;
+    __capacity = size + size / 8;
+    __tokens = tokens;
+}
+
+/*!
+    Starts collecting the nodes of tokens reparsed tokens, for replace().
+    The post order region of the last parse is reused when it is big
+    enough.
+*/
+void Ast::start_subtree(qsizetype tokens) {
+    __post_size = 0;
+    reserve_post_order(3 * tokens + 4);
+}
+
+/*!
+    Puts the subtree collected since start_subtree() in place of node,
+    whose tokens were replaced, and moves the tokens of the nodes after it
+    by token_shift. Every other node is reused as it is. The tree is edited
+    in place while it fits its region; a bigger region is taken from the
+    arena otherwise, and the tree is moved to the front of the arena once
+    old regions take most of it.
+*/
+void Ast::replace(qsizetype node, qint32 token_shift) {
+    const qsizetype removed = __nodes[node].size;
+    const qsizetype added = __post_size;
+    const qsizetype size = __size - removed + added;
+    AstNode* nodes = __nodes;
+
+    if (size > __capacity) {
+        __capacity = size + size / 8;
+        nodes = __arena.allocate<AstNode>(__capacity);
+        std::copy(__nodes, __nodes + node, nodes);
+        std::copy(__nodes + node + removed, __nodes + __size, nodes + node + added);
+    }
+    else if (added != removed)
+        std::memmove(nodes + node + added, nodes + node + removed,
+                     (__size - node - removed) * sizeof(AstNode));
+
+    for (qsizetype i = 0; i < node; i++)
+        if (i + (qsizetype)nodes[i].size > node) {
+            nodes[i].size = (quint32)(nodes[i].size - removed + added);
+            nodes[i].last += token_shift;
+        }
+
+    layout(nodes + node);
+
+    if (token_shift != 0)
+        for (qsizetype i = node + added; i < size; i++) {
+            nodes[i].first += token_shift;
+            nodes[i].last += token_shift;
+        }
+
+    __nodes = nodes;
+    __size = size;
+    __tokens += token_shift;
+    __post_size = 0;
+
+    /*
+        reset() keeps the memory, and the first region it hands out is
+        never past the one the tree is in: it is in an earlier block, or
+        at the start of the same one. So the tree moves down with one
+        memmove, and the post order region is taken anew when needed.
+    */
+    if (__arena.used() > 4 * (__capacity + __post_capacity) * (qsizetype)sizeof(AstNode)) {
+        __arena.reset();
+        nodes = __arena.allocate<AstNode>(__capacity);
+        std::memmove(nodes, __nodes, __size * sizeof(AstNode));
+        __nodes = nodes;
+        __post_order = nullptr;
+        __post_capacity = 0;
+    }
+}
+
+/*!
+    Returns the outermost rule node covering exactly the tokens from first
+    to last, -1 if there is none.
+*/
+qsizetype Ast::find(qint32 first, qint32 last) const {
+    qsizetype i = 0, end = __size;
+
+    while (i < end) {
+        const AstNode& node = __nodes[i];
+
+        if (node.first <= first && last <= node.last) {
+            if (node.first == first && node.last == last)
+                return node.rule >= 0 ? i : -1;
+            end = i + node.size;
+            i++;
+        }
+        else
+            i += node.size;
+    }
+    return -1;
+}
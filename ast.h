@@ -0,0 +1,73 @@
+#ifndef AST_H
+#define AST_H
+
+#include "arena.h"
+#include "parser_rules.h"
+
+/*!
+    A node of the syntax tree: one per applied rule, plus a leaf for every
+    id or const. Keywords and delimeters are implied by the rule.
+*/
+struct AstNode {
+    quint32 size;       // nodes in the subtree, this one included
+    qint32 first;       // index of the first token the node covers
+    qint32 last;        // index of the last token the node covers
+    qint16 rule;        // index in rules, -1 for a leaf
+    quint16 children;
+    RuleType type;      // RuleType::ID for a leaf
+};
+
+/*!
+    Flat syntax tree built by the parser during reductions.
+    Reductions write their nodes in post order straight into the arena,
+    and finish() lays them out in pre order in a second region of it: the
+    first child of node i is i + 1, its next sibling is i + at(i).size, so
+    traversals are linear sweeps. Everything a parse allocates, scratch
+    included, lives in the arena, so clear() frees it with one reset.
+    Token indices refer to the parsed input, which is the lexer's
+    TokenStore for Parser::analyze().
+*/
+class Ast {
+    Arena __arena;
+    AstNode* __post_order = nullptr;
+    qsizetype __post_size = 0;
+    qsizetype __post_capacity = 0;
+    AstNode* __nodes = nullptr;
+    qsizetype __size = 0;
+    qsizetype __capacity = 0;
+    qsizetype __tokens = 0;
+
+    void reserve_post_order(qsizetype nodes);
+    AstNode& emit();
+    void layout(AstNode* out);
+
+public:
+    Ast() = default;
+
+    void clear();
+    void reserve(qsizetype tokens);
+
+    void add_leaf(qint32 token);
+    void add_node(qint16 rule, RuleType type, quint16 children, qint32 first, qint32 last);
+    void finish(qsizetype tokens);
+
+    void start_subtree(qsizetype tokens);
+    void replace(qsizetype node, qint32 token_shift);
+
+    qsizetype find(qint32 first, qint32 last) const;
+
+    qsizetype size() const { return __size; }
+    bool isEmpty() const { return __size == 0; }
+    const AstNode& at(qsizetype i) const { return __nodes[i]; }
+    const AstNode& operator[](qsizetype i) const { return __nodes[i]; }
+    const AstNode* begin() const { return __nodes; }
+    const AstNode* end() const { return __nodes + __size; }
+
+    qsizetype first_child(qsizetype i) const { return __nodes[i].children ? i + 1 : -1; }
+    qsizetype next_sibling(qsizetype i) const { return i + __nodes[i].size; }
+
+    qsizetype memory() const { return __size * (qsizetype)sizeof(AstNode); }
+    double bytes_per_token() const { return __tokens ? (double)memory() / __tokens : 0; }
+};
+
+#endif // AST_H
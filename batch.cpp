@@ -0,0 +1,149 @@
+#include "batch.h"
+
+#include <QDirIterator>
+#include <QElapsedTimer>
+#include <QThread>
+
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace {
+
+/*!
+    Indices of the files a worker still has to compile. The owner works
+    from the back, thieves from the front, so they only meet on the last
+    file.
+*/
+class WorkQueue {
+    std::mutex __mutex;
+    std::deque<qsizetype> __files;
+
+public:
+    void push(qsizetype file) { __files.push_back(file); }
+
+    bool pop(qsizetype& file) {
+        std::lock_guard<std::mutex> lock(__mutex);
+        if (__files.empty())
+            return false;
+        file = __files.back();
+        __files.pop_back();
+        return true;
+    }
+
+    bool steal(qsizetype& file) {
+        std::lock_guard<std::mutex> lock(__mutex);
+        if (__files.empty())
+            return false;
+        file = __files.front();
+        __files.pop_front();
+        return true;
+    }
+};
+
+} // namespace
+
+BatchCompiler::BatchCompiler(int threads, CompileOptions options)
+    : __threads(threads > 0 ? threads : QThread::idealThreadCount()), __options(options) {
+    // The pool is the parallelism; each file is lexed on its worker.
+    __options.lexer_threads = 1;
+}
+
+QStringList BatchCompiler::collect(const QString& directory) {
+    QStringList files;
+    QDirIterator it(directory, {"*.dsl"}, QDir::Files, QDirIterator::Subdirectories);
+    while (it.hasNext())
+        files.append(it.next());
+    files.sort();
+    return files;
+}
+
+/*!
+    No file is added once the workers start, so a worker is done as soon
+    as its own queue and every other one are empty.
+*/
+BatchReport BatchCompiler::run(const QStringList& files) {
+    QElapsedTimer timer;
+    timer.start();
+
+    const int threads = (int)qBound<qsizetype>(1, __threads, qMax<qsizetype>(files.size(), 1));
+    std::vector<WorkQueue> queues(threads);
+    for (qsizetype i = 0; i < files.size(); i++)
+        queues[i % threads].push(i);
+
+    std::vector<CompileResult> results(files.size());
+    std::atomic<qsizetype> steals = 0;
+
+    auto work = [&](int self) {
+        Compiler compiler(__options);
+        qsizetype file;
+
+        for (;;) {
+            if (!queues[self].pop(file)) {
+                bool stolen = false;
+                for (int i = 1; i < threads && !stolen; i++)
+                    stolen = queues[(self + i) % threads].steal(file);
+                if (!stolen)
+                    return;
+                steals.fetch_add(1, std::memory_order_relaxed);
+            }
+            results[file] = compiler.compile(files.at(file));
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (int i = 1; i < threads; i++)
+        workers.emplace_back(work, i);
+    work(0);
+    for (std::thread& worker : workers)
+        worker.join();
+
+    BatchReport report;
+    report.files = files.size();
+    report.threads = threads;
+    report.steals = steals;
+
+    for (CompileResult& result : results) {
+        report.bytes += result.bytes;
+        report.tokens += result.tokens;
+        report.ast_nodes += result.ast_nodes;
+        report.compile_nanoseconds += result.nanoseconds;
+
+        if (result.ok())
+            report.succeeded++;
+        else
+            report.failures.append(std::move(result));
+    }
+
+    report.wall_nanoseconds = timer.nsecsElapsed();
+    return report;
+}
+
+QString BatchReport::toQString() const {
+    const double wall = wall_nanoseconds / 1e9;
+    const double cpu = compile_nanoseconds / 1e9;
+
+    QString text = QString("%1 files, %2 succeeded, %3 failed\n")
+                       .arg(files).arg(succeeded).arg(failed());
+    text += QString("%1 bytes, %2 tokens, %3 AST nodes\n")
+                .arg(bytes).arg(tokens).arg(ast_nodes);
+    text += QString("%1 threads, %2 s wall, %3 s compiling (%4x), %5 steals\n")
+                .arg(threads)
+                .arg(wall, 0, 'f', 3)
+                .arg(cpu, 0, 'f', 3)
+                .arg(wall > 0 ? cpu / wall : 0, 0, 'f', 1)
+                .arg(steals);
+    text += QString("%1 files/s, %2 MB/s\n")
+                .arg(wall > 0 ? files / wall : 0, 0, 'f', 0)
+                .arg(wall > 0 ? bytes / wall / 1e6 : 0, 0, 'f', 1);
+
+    for (const CompileResult& failure : failures) {
+        text += QString("\n%1: %2 failed\n")
+                    .arg(failure.filename, CompileResult::stage_name(failure.stage));
+        for (const QString& message : failure.messages)
+            text += "    " + message + "\n";
+    }
+    return text;
+}
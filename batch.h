@@ -0,0 +1,51 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <QList>
+#include <QString>
+#include <QStringList>
+
+#include "compiler.h"
+
+/*!
+    Totals of a batch compile. Only the failed compiles are kept whole.
+*/
+struct BatchReport {
+    qsizetype files = 0;
+    qsizetype succeeded = 0;
+    qsizetype bytes = 0;
+    qsizetype tokens = 0;
+    qsizetype ast_nodes = 0;
+    qsizetype steals = 0;       // files a worker took from another's queue
+    int threads = 0;
+    qint64 wall_nanoseconds = 0;
+    qint64 compile_nanoseconds = 0; // summed over all files
+    QList<CompileResult> failures;  // in the order of the input files
+
+    qsizetype failed() const { return files - succeeded; }
+    QString toQString() const;
+};
+
+/*!
+    Compiles many sources on a pool of threads. Every worker owns a
+    Compiler, so its lexer tables and parser arena are reused from one file
+    to the next and never shared. Files are dealt out to per-worker queues
+    up front; a worker takes from the back of its own queue and, once it
+    runs dry, steals from the front of the others', so a few large files
+    do not leave the rest of the pool idle.
+*/
+class BatchCompiler {
+    int __threads;
+    CompileOptions __options;
+
+public:
+    explicit BatchCompiler(int threads = 0, CompileOptions options = {});
+
+    //! Every .dsl file under directory, sorted.
+    static QStringList collect(const QString& directory);
+
+    BatchReport run(const QStringList& files);
+    BatchReport run(const QString& directory) { return run(collect(directory)); }
+};
+
+#endif // BATCH_H
@@ -0,0 +1,52 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <QElapsedTimer>
+#include <QString>
+#include <QTextStream>
+
+#include <cstdio>
+#include <limits>
+
+/*!
+    Helpers shared by the microbenchmarks. Every benchmark is a plain
+    executable that prints one table to stdout; none of them is run by
+    ctest, since their numbers depend on the machine.
+*/
+namespace bench {
+
+/*!
+    Runs f repeats times and returns the fastest run in nanoseconds, so
+    one descheduled run does not skew the table.
+*/
+template<class F>
+qint64 best_of(int repeats, F&& f) {
+    qint64 best = std::numeric_limits<qint64>::max();
+    for (int i = 0; i < repeats; i++) {
+        QElapsedTimer timer;
+        timer.start();
+        f();
+        best = qMin(best, timer.nsecsElapsed());
+    }
+    return best;
+}
+
+//! Keeps the compiler from dropping work whose result nothing reads.
+inline volatile quint64 sink = 0;
+
+template<class T>
+void keep(T value) { sink = sink + (quint64)value; }
+
+inline QTextStream& out() {
+    static QTextStream stream(stdout);
+    return stream;
+}
+
+//! A number with the given decimals, right-aligned in width characters.
+inline QString fixed(double value, int width, int decimals = 1) {
+    return QString::number(value, 'f', decimals).rightJustified(width);
+}
+
+} // namespace bench
+
+#endif // BENCH_H
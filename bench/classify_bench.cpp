@@ -0,0 +1,102 @@
+#include "bench.h"
+#include "lexer.h"
+
+#include <QByteArray>
+#include <QList>
+#include <QMap>
+#include <QRegularExpression>
+
+/*!
+    Token classification: the Lexema constructor (perfect hash and
+    character checks) against the QMap lookup and QRegularExpression
+    matching it replaced, on the same mix of keywords, delimeters, ids,
+    constants and invalid words.
+*/
+
+namespace {
+
+//! Lexema classification as it was before the perfect hash.
+namespace regex_path {
+
+QMap<QString, TokenType> make_associations() {
+    QMap<QString, TokenType> associations;
+    for (const Association& a : lexemas_associations)
+        associations.insert(QString::fromUtf8(a.text.data(), (qsizetype)a.text.size()), a.type);
+    return associations;
+}
+
+const QMap<QString, TokenType> associations = make_associations();
+const QString id_pattern = "^\\w\\d*\\w$";
+const QString const_pattern = "^(\\d+|-\\d+)$";
+
+bool is_id(const QString& candidate) {
+    QRegularExpression re = QRegularExpression(id_pattern);
+    QRegularExpressionMatchIterator matches = re.globalMatch(candidate);
+    return matches.hasNext() && matches.next().hasMatch() && !matches.hasNext();
+}
+
+bool is_const(const QString& candidate) {
+    QRegularExpression re = QRegularExpression(const_pattern);
+    return re.match(candidate).hasMatch();
+}
+
+//! Constants are tried first, in the order the lexer uses now.
+TokenType classify(QByteArrayView text) {
+    QString value = QString::fromUtf8(text);
+    if (associations.contains(value))
+        return associations.value(value);
+    if (is_const(value))
+        return TokenType::Const;
+    if (is_id(value))
+        return TokenType::Id;
+    return TokenType::Error;
+}
+
+} // namespace regex_path
+
+// Roughly the mix of a generated test program
+const char* const pool[] = {
+    "let", "v0a", "=", "(", "v1a", "+", "42", ")", "*", "v2a", ";",
+    "if", "then", "begin", "end", "else", "while", "output", "input",
+    "c1c", "-", "7", "/", "-13", "1024", "x9y", ",", "var", "int",
+    "program", ".", "a", "9z", "v12b", "100000",
+};
+
+} // namespace
+
+int main() {
+    const qsizetype count = 200000;
+    QList<QByteArray> texts;
+    texts.reserve(count);
+    quint32 state = 12345;
+    for (qsizetype i = 0; i < count; i++) {
+        state = state * 1103515245u + 12345u;
+        texts.append(QByteArray(pool[(state >> 16) % std::size(pool)]));
+    }
+
+    // Both paths must agree before either is timed
+    for (const QByteArray& text : texts)
+        if (Lexema(text).type() != regex_path::classify(text)) {
+            bench::out() << "mismatch on " << QString::fromUtf8(text) << "\n";
+            return 1;
+        }
+
+    const qint64 regex_ns = bench::best_of(3, [&] {
+        for (const QByteArray& text : texts)
+            bench::keep((int)regex_path::classify(text));
+    });
+    const qint64 hash_ns = bench::best_of(10, [&] {
+        for (const QByteArray& text : texts)
+            bench::keep((int)Lexema(text).type());
+    });
+
+    bench::out() << "classify " << count << " tokens\n"
+                 << "    QMap + QRegularExpression " << bench::fixed(double(regex_ns) / count, 8)
+                 << " ns/token\n"
+                 << "    perfect hash + checks     " << bench::fixed(double(hash_ns) / count, 8)
+                 << " ns/token\n"
+                 << "    speedup                   " << bench::fixed(double(regex_ns) / hash_ns, 8)
+                 << "x\n";
+    bench::out().flush();
+    return 0;
+}
@@ -0,0 +1,187 @@
+#include "bench.h"
+#include "parser_rules.h"
+
+#include <QList>
+
+#include <memory>
+#include <set>
+#include <vector>
+
+/*!
+    Cost of finding the handle to reduce, in ns per reduce, against the
+    number of grammar rules: the RuleTrie walk against the linear scan
+    over every rule it replaced. The first row is the shipped grammar,
+    the others are random grammars of growing size whose handles are as
+    long as the shipped ones. Every stack ends with the handle of some
+    rule, under a few random symbols.
+*/
+
+namespace {
+
+struct Handle {
+    quint8 length;
+    std::array<quint8, Rule::max_handle> symbols;
+};
+
+//! The old matcher: every rule is checked against the stack top.
+template <typename SymbolAt>
+qint16 linear_match(const std::vector<Handle>& handles, qsizetype depth, SymbolAt symbol_at) {
+    qint16 found = -1;
+    quint8 found_length = 0;
+
+    for (std::size_t r = 0; r < handles.size(); r++) {
+        const Handle& handle = handles[r];
+        if (handle.length > depth || handle.length <= found_length)
+            continue;
+
+        bool matches = true;
+        for (quint8 i = 0; i < handle.length && matches; i++)
+            matches = handle.symbols[handle.length - 1 - i] == symbol_at(i);
+        if (matches) {
+            found = (qint16)r;
+            found_length = handle.length;
+        }
+    }
+    return found;
+}
+
+constexpr std::size_t max_nodes = 1 << 14;
+using Trie = RuleTrie<max_nodes>;
+
+//! Builds the trie of the handles read backwards, as grammarc does.
+std::unique_ptr<Trie> make_trie(const std::vector<Handle>& handles) {
+    static RuleTrieEdge edges[max_nodes];
+    static qint16 node_rules[max_nodes];
+
+    // Unused edges point the last node nowhere, which it already does
+    std::fill(std::begin(edges), std::end(edges), RuleTrieEdge {max_nodes - 1, 0, -1});
+    std::fill(std::begin(node_rules), std::end(node_rules), qint16(-1));
+
+    std::vector<std::array<qint16, grammar::COUNT>> next(1);
+    next[0].fill(-1);
+    std::size_t edge_count = 0;
+
+    for (std::size_t r = 0; r < handles.size(); r++) {
+        const Handle& handle = handles[r];
+        qint16 node = 0;
+        for (int i = handle.length - 1; i >= 0; i--) {
+            quint8 symbol = handle.symbols[i];
+            if (next[node][symbol] < 0) {
+                next[node][symbol] = (qint16)next.size();
+                edges[edge_count++] = {node, symbol, (qint16)next.size()};
+                next.emplace_back().fill(-1);
+            }
+            node = next[node][symbol];
+        }
+        node_rules[node] = (qint16)r;
+    }
+    if (next.size() >= max_nodes)
+        throw std::runtime_error("reduce_bench: grammar too large for the trie");
+
+    return std::make_unique<Trie>(edges, node_rules);
+}
+
+//! count distinct random handles of 1 to 9 symbols.
+std::vector<Handle> random_handles(std::size_t count, quint32& state) {
+    std::vector<Handle> handles;
+    std::set<std::vector<quint8>> seen;
+    while (handles.size() < count) {
+        Handle handle {};
+        state = state * 1103515245u + 12345u;
+        handle.length = (quint8)(1 + (state >> 16) % 9);
+        for (quint8 i = 0; i < handle.length; i++) {
+            state = state * 1103515245u + 12345u;
+            handle.symbols[i] = (quint8)((state >> 16) % grammar::COUNT);
+        }
+        if (seen.insert({handle.symbols.begin(), handle.symbols.begin() + handle.length}).second)
+            handles.push_back(handle);
+    }
+    return handles;
+}
+
+//! Stacks made of a few random symbols topped by the handle of a random rule.
+QList<std::vector<quint8>> random_stacks(const std::vector<Handle>& handles, qsizetype count,
+                                         quint32& state) {
+    QList<std::vector<quint8>> stacks;
+    stacks.reserve(count);
+    for (qsizetype s = 0; s < count; s++) {
+        std::vector<quint8> stack;
+        for (int i = 0; i < 4; i++) {
+            state = state * 1103515245u + 12345u;
+            stack.push_back((quint8)((state >> 16) % grammar::COUNT));
+        }
+        state = state * 1103515245u + 12345u;
+        const Handle& handle = handles[(state >> 16) % handles.size()];
+        stack.insert(stack.end(), handle.symbols.begin(), handle.symbols.begin() + handle.length);
+        stacks.append(std::move(stack));
+    }
+    return stacks;
+}
+
+struct Timing {
+    double trie_ns;
+    double linear_ns;
+};
+
+template <typename TrieType>
+Timing time_reduces(const TrieType& trie, const std::vector<Handle>& handles,
+                    const QList<std::vector<quint8>>& stacks) {
+    auto match_all = [&](auto&& match) {
+        for (const std::vector<quint8>& stack : stacks) {
+            const qsizetype depth = (qsizetype)stack.size();
+            bench::keep(match(depth, [&](qsizetype i) { return stack[depth - 1 - i]; }));
+        }
+    };
+
+    // Both matchers must agree before either is timed
+    for (const std::vector<quint8>& stack : stacks) {
+        const qsizetype depth = (qsizetype)stack.size();
+        auto symbol_at = [&](qsizetype i) { return stack[depth - 1 - i]; };
+        if (trie.match(depth, symbol_at) != linear_match(handles, depth, symbol_at))
+            throw std::runtime_error("reduce_bench: the trie and the linear scan disagree");
+    }
+
+    const qint64 trie_ns = bench::best_of(10, [&] {
+        match_all([&](qsizetype depth, auto symbol_at) { return trie.match(depth, symbol_at); });
+    });
+    const qint64 linear_ns = bench::best_of(10, [&] {
+        match_all([&](qsizetype depth, auto symbol_at) {
+            return linear_match(handles, depth, symbol_at);
+        });
+    });
+    return {double(trie_ns) / stacks.size(), double(linear_ns) / stacks.size()};
+}
+
+void print_row(std::size_t rules, const Timing& timing) {
+    bench::out() << QString::number(rules).rightJustified(7)
+                 << bench::fixed(timing.trie_ns, 10, 1)
+                 << bench::fixed(timing.linear_ns, 10, 1)
+                 << bench::fixed(timing.linear_ns / timing.trie_ns, 10, 1) << "x\n";
+}
+
+} // namespace
+
+int main() {
+    const qsizetype count = 1 << 16;
+    quint32 state = 12345;
+
+    bench::out() << "ns per reduce over " << count << " stacks\n"
+                 << "  rules      trie    linear   speedup\n";
+    try {
+        std::vector<Handle> shipped;
+        for (const Rule& rule : rules)
+            shipped.push_back({rule.length, rule.handle});
+        print_row(shipped.size(), time_reduces(rule_trie, shipped, random_stacks(shipped, count, state)));
+
+        for (std::size_t size : {32, 128, 512, 1024}) {
+            const std::vector<Handle> handles = random_handles(size, state);
+            const std::unique_ptr<Trie> trie = make_trie(handles);
+            print_row(size, time_reduces(*trie, handles, random_stacks(handles, count, state)));
+        }
+    } catch (const std::runtime_error& error) {
+        bench::out() << error.what() << "\n";
+        return 1;
+    }
+    bench::out().flush();
+    return 0;
+}
@@ -0,0 +1,82 @@
+#include "bench.h"
+#include "scan.h"
+
+#include <QByteArray>
+
+#include <iterator>
+
+/*!
+    Throughput of the run-skipping kernels in MB/s, per instruction set,
+    for runs of a fixed length: a buffer of runs of whitespace or of
+    letters and digits, each ended by one byte that stops the kernel, is
+    skipped run by run. Short runs are what sources mostly have, long
+    runs show the peak.
+*/
+
+namespace {
+
+const scan::Isa isas[] = {scan::Isa::Scalar, scan::Isa::SSE2};
+const char* const isa_names[] = {"scalar", "sse2"};
+
+QByteArray make_runs(char fill, char stop, qsizetype run, qsizetype bytes) {
+    QByteArray text;
+    text.reserve(bytes + run + 1);
+    while (text.size() < bytes) {
+        text.append(QByteArray(run, fill));
+        text.append(stop);
+    }
+    return text;
+}
+
+using Kernel = const char* (*)(scan::Isa, const char*, const char*);
+
+//! MB/s of skipping every run of text with kernel.
+double throughput(Kernel kernel, scan::Isa isa, const QByteArray& text) {
+    const char* begin = text.constData();
+    const char* end = begin + text.size();
+    const qint64 ns = bench::best_of(7, [&] {
+        qsizetype runs = 0;
+        for (const char* p = begin; p != end; p++, runs++)
+            p = kernel(isa, p, end);
+        bench::keep(runs);
+    });
+    return double(text.size()) * 1000.0 / ns;
+}
+
+} // namespace
+
+int main() {
+    const qsizetype bytes = 8 << 20;
+    const qsizetype runs[] = {1, 4, 16, 64, 256, 4096};
+
+    struct Case {
+        const char* name;
+        Kernel kernel;
+        char fill;
+        char stop;
+    };
+    const Case cases[] = {
+        {"whitespace", scan::skip_whitespace, ' ', 'x'},
+        {"word", scan::skip_alnum, 'a', ' '},
+    };
+
+    bench::out() << "MB/s over " << (bytes >> 20) << " MiB of runs of a given length\n";
+    for (const Case& c : cases) {
+        bench::out() << "\n" << QString(c.name).leftJustified(12) << "run";
+        for (std::size_t i = 0; i < std::size(isas); i++)
+            if (scan::has_isa(isas[i]))
+                bench::out() << QString(isa_names[i]).rightJustified(10);
+        bench::out() << "\n";
+
+        for (qsizetype run : runs) {
+            const QByteArray text = make_runs(c.fill, c.stop, run, bytes);
+            bench::out() << QString::number(run).rightJustified(15);
+            for (std::size_t i = 0; i < std::size(isas); i++)
+                if (scan::has_isa(isas[i]))
+                    bench::out() << bench::fixed(throughput(c.kernel, isas[i], text), 10, 0);
+            bench::out() << "\n";
+        }
+    }
+    bench::out().flush();
+    return 0;
+}
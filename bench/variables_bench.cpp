@@ -0,0 +1,163 @@
+#include "bench.h"
+#include "variables.h"
+
+#include <QElapsedTimer>
+#include <QSet>
+#include <QString>
+
+#include <stdexcept>
+#include <vector>
+
+/*!
+    VariableTable on 100k variables: ns per declaration, per lookup and
+    per declaration undone when its scope is left, for the ways a program
+    can spread its declarations over scopes. The last row is the
+    QSet<QString> the semantic analyzer kept before, which had no scopes
+    at all, on the same names.
+*/
+
+namespace {
+
+constexpr qint32 count = 100000;
+
+struct Timing {
+    qint64 declare = std::numeric_limits<qint64>::max();
+    qint64 lookup = std::numeric_limits<qint64>::max();
+    qint64 leave = std::numeric_limits<qint64>::max();
+    qint64 lookups = 0;
+};
+
+/*!
+    Runs one layout of scopes repeats times and keeps the fastest time of
+    each phase. depth scopes are entered one inside the other, each
+    declares count / depth symbols; every symbol is then looked up once
+    and once more as a miss, and the scopes are left. With siblings set,
+    each scope is left before the next one is entered and the lookups of
+    a scope happen inside it. shadow makes every scope declare the same
+    symbols.
+*/
+Timing run(qint32 depth, bool siblings, bool shadow) {
+    const qint32 per_scope = count / depth;
+    auto symbol = [&](qint32 scope, qint32 i) { return shadow ? i : scope * per_scope + i; };
+
+    VariableTable table;
+    Timing best;
+    for (int repeat = 0; repeat < 5; repeat++) {
+        table.clear();
+        table.reserve(count);
+        Timing timing {0, 0, 0, 0};
+        qint64 found = 0;
+        QElapsedTimer timer;
+
+        auto lookup_scope = [&](qint32 scope) {
+            for (qint32 i = 0; i < per_scope; i++) {
+                found += table.find(symbol(scope, i))->scope;
+                found += table.contains(count + symbol(scope, i));
+            }
+            timing.lookups += 2 * per_scope;
+        };
+
+        for (qint32 scope = 0; scope < depth; scope++) {
+            timer.start();
+            table.enter_scope();
+            for (qint32 i = 0; i < per_scope; i++)
+                table.declare(symbol(scope, i));
+            timing.declare += timer.nsecsElapsed();
+
+            if (siblings) {
+                timer.start();
+                lookup_scope(scope);
+                timing.lookup += timer.nsecsElapsed();
+
+                timer.start();
+                table.leave_scope();
+                timing.leave += timer.nsecsElapsed();
+            }
+        }
+
+        if (!siblings) {
+            timer.start();
+            for (qint32 scope = 0; scope < depth; scope++)
+                lookup_scope(shadow ? depth - 1 : scope);
+            timing.lookup = timer.nsecsElapsed();
+
+            timer.start();
+            for (qint32 scope = 0; scope < depth; scope++)
+                table.leave_scope();
+            timing.leave = timer.nsecsElapsed();
+        }
+        bench::keep(found);
+
+        if (table.size() != 0)
+            throw std::runtime_error("variables_bench: variables left after the last scope");
+
+        best.declare = qMin(best.declare, timing.declare);
+        best.lookup = qMin(best.lookup, timing.lookup);
+        best.leave = qMin(best.leave, timing.leave);
+        best.lookups = timing.lookups;
+    }
+    return best;
+}
+
+//! The old table: one QSet of names for the whole program.
+Timing run_qset(const std::vector<QString>& names, const std::vector<QString>& missing) {
+    Timing best;
+    for (int repeat = 0; repeat < 5; repeat++) {
+        QSet<QString> declared;
+        qint64 found = 0;
+        QElapsedTimer timer;
+
+        timer.start();
+        for (const QString& name : names)
+            declared.insert(name);
+        best.declare = qMin(best.declare, timer.nsecsElapsed());
+
+        timer.start();
+        for (qsizetype i = 0; i < (qsizetype)names.size(); i++) {
+            found += declared.contains(names[i]);
+            found += declared.contains(missing[i]);
+        }
+        best.lookup = qMin(best.lookup, timer.nsecsElapsed());
+        bench::keep(found);
+
+        timer.start();
+        declared.clear();
+        best.leave = qMin(best.leave, timer.nsecsElapsed());
+        best.lookups = 2 * (qint64)names.size();
+    }
+    return best;
+}
+
+void print_row(const char* name, const Timing& timing) {
+    bench::out() << QString(name).leftJustified(30)
+                 << bench::fixed(double(timing.declare) / count, 10)
+                 << bench::fixed(double(timing.lookup) / timing.lookups, 10)
+                 << bench::fixed(double(timing.leave) / count, 10) << "\n";
+}
+
+} // namespace
+
+int main() {
+    std::vector<QString> names, missing;
+    for (qint32 i = 0; i < count; i++) {
+        names.push_back(QString("v%1a").arg(i));
+        missing.push_back(QString("w%1a").arg(i));
+    }
+
+    bench::out() << "ns per operation, " << count << " variables\n"
+                 << QString("scopes").leftJustified(30)
+                 << "   declare    lookup     leave\n";
+    try {
+        print_row("1", run(1, false, false));
+        print_row("100 nested", run(100, false, false));
+        print_row("1000 nested", run(1000, false, false));
+        print_row("1000 siblings", run(1000, true, false));
+        print_row("100 nested, all shadowing", run(100, false, true));
+        print_row("QSet<QString>, no scopes", run_qset(names, missing));
+    } catch (const std::runtime_error& error) {
+        bench::out() << error.what() << "\n";
+        return 1;
+    }
+    bench::out().flush();
+    return 0;
+}
@@ -0,0 +1,122 @@
+#include "compiler.h"
+#include "irbuilder.h"
+#include "passes.h"
+#include "translation.h"
+
+#include <QElapsedTimer>
+#include <QFile>
+#include <QTextStream>
+
+const char* CompileResult::stage_name(Stage stage) {
+    switch (stage) {
+    case Stage::Load: return "load";
+    case Stage::Lexing: return "lexing";
+    case Stage::Parsing: return "parsing";
+    case Stage::Semantics: return "semantics";
+    case Stage::Codegen: return "codegen";
+    case Stage::Done: return "done";
+    }
+    return "done";
+}
+
+Compiler::Compiler(CompileOptions options)
+    : __options(options), __parser(&__lexer) {
+    __lexer.set_collect_diagnostics(true);
+    __parser.set_collect_diagnostics(true);
+}
+
+CompileResult Compiler::compile(const QString& filename) {
+    QSharedPointer<const SourceBuffer> source = SourceBuffer::fromFile(filename);
+    if (source.isNull()) {
+        CompileResult result;
+        result.filename = filename;
+        result.messages.append(QString("%1: cannot open").arg(filename));
+        return result;
+    }
+    return compile(source);
+}
+
+namespace {
+
+void add_messages(CompileResult& result, const SourceBuffer& source,
+                  const QList<Diagnostic>& diagnostics) {
+    for (const Diagnostic& d : diagnostics)
+        result.messages.append(QString("%1: %2").arg(source.location(d.offset), d.message));
+}
+
+} // namespace
+
+/*!
+    Runs the stages in order and stops at the first one that fails.
+    Nothing is thrown: every error ends up in the messages.
+*/
+CompileResult Compiler::compile(QSharedPointer<const SourceBuffer> source) {
+    QElapsedTimer timer;
+    timer.start();
+
+    CompileResult result;
+    result.filename = source->name();
+    result.bytes = source->size();
+
+    try {
+        run(source, result);
+    }
+    catch (const std::exception& e) {
+        result.messages.append(QString("%1: %2").arg(source->name(), e.what()));
+    }
+
+    result.nanoseconds = timer.nsecsElapsed();
+    return result;
+}
+
+void Compiler::run(QSharedPointer<const SourceBuffer> source, CompileResult& result) {
+    __lexer.loadSource(source);
+
+    result.stage = CompileResult::Stage::Lexing;
+    bool lexed = __lexer.analyze_parallel(__options.lexer_threads);
+    result.tokens = __lexer.get_tokenized_code().size();
+    if (!lexed)
+        return add_messages(result, *source, __lexer.get_diagnostics());
+
+    result.stage = CompileResult::Stage::Parsing;
+    if (!__parser.analyze())
+        return add_messages(result, *source, __parser.diagnostics());
+    result.ast_nodes = __parser.ast().size();
+
+    result.stage = CompileResult::Stage::Semantics;
+    if (__parser.hasSemanticErrors()) {
+        result.messages.append(__parser.getSemanticErrors());
+        return;
+    }
+
+    result.stage = CompileResult::Stage::Codegen;
+    if (!__options.generate_asm && !__options.dump_ir) {
+        result.stage = CompileResult::Stage::Done;
+        return;
+    }
+
+    ir::Builder(&__lexer, &__parser.ast()).build(__function);
+    ir::PassManager passes = ir::PassManager::standard();
+    passes.set_verify(__options.verify_ir);
+    passes.run(__function);
+
+    if (__options.dump_ir) {
+        const QString filename = source->is_file() ? source->filename() + ".ir" : "a.ir";
+        QFile file(filename);
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Text)) {
+            result.messages.append(QString("%1: cannot write").arg(filename));
+            return;
+        }
+        QTextStream(&file) << __function.dump(&__lexer.get_ids());
+    }
+
+    if (__options.generate_asm) {
+        AsmGenerator asmgen(&__lexer, &__function, &__parser.variables());
+        if (!asmgen.generate(__lexer.filename())) {
+            result.messages.append(QString("%1: cannot write").arg(__lexer.filename()));
+            return;
+        }
+    }
+
+    result.stage = CompileResult::Stage::Done;
+}
@@ -0,0 +1,73 @@
+#ifndef COMPILER_H
+#define COMPILER_H
+
+#include <QString>
+#include <QStringList>
+
+#include "ir.h"
+#include "lexer.h"
+#include "parser.h"
+
+struct CompileOptions {
+    bool generate_asm = true;   // write <source>.asm next to the source
+    bool dump_ir = false;       // write the optimized IR to <source>.ir
+    bool verify_ir = false;     // check the IR after every pass that changes it
+    int lexer_threads = 1;      // for Lexer::analyze_parallel, 1 lexes serially
+};
+
+/*!
+    What one compile produced. Messages are rendered with their
+    locations, so a result does not keep the source alive.
+*/
+struct CompileResult {
+    enum class Stage {
+        Load,
+        Lexing,
+        Parsing,
+        Semantics,
+        Codegen,
+        Done,
+    };
+
+    QString filename;
+    Stage stage = Stage::Load;  // the stage that failed, Done if none did
+    QStringList messages;
+    qsizetype bytes = 0;
+    qsizetype tokens = 0;
+    qsizetype ast_nodes = 0;
+    qint64 nanoseconds = 0;
+
+    bool ok() const { return stage == Stage::Done; }
+    static const char* stage_name(Stage stage);
+};
+
+/*!
+    The whole pipeline (lexer, parser with the semantic analyzer, the IR
+    builder and its passes, and the assembly generator) for one source at
+    a time. A Compiler owns all of
+    its state and the tables it reads are constexpr, so separate Compilers
+    can run on separate threads at once. Reused for many sources, a
+    Compiler keeps the memory of its symbol tables and of its parser's
+    arena, so later compiles allocate little.
+*/
+class Compiler {
+    CompileOptions __options;
+    Lexer __lexer;
+    Parser __parser;
+    ir::Function __function;
+
+    void run(QSharedPointer<const SourceBuffer> source, CompileResult& result);
+
+public:
+    explicit Compiler(CompileOptions options = {});
+    Q_DISABLE_COPY_MOVE(Compiler)
+
+    CompileResult compile(const QString& filename);
+    CompileResult compile(QSharedPointer<const SourceBuffer> source);
+
+    const Lexer& lexer() const { return __lexer; }
+    const Parser& parser() const { return __parser; }
+    const ir::Function& function() const { return __function; }
+};
+
+#endif // COMPILER_H
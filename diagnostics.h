@@ -0,0 +1,16 @@
+#ifndef DIAGNOSTICS_H
+#define DIAGNOSTICS_H
+
+#include <QList>
+#include <QString>
+
+/*!
+    A problem found in the source, located by its byte offset.
+*/
+struct Diagnostic {
+    quint32 offset = 0;
+    quint32 length = 0;
+    QString message;
+};
+
+#endif // DIAGNOSTICS_H
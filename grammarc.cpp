@@ -0,0 +1,432 @@
+/*!
+    grammarc - compiles the grammar description into grammar_tables.h.
+
+    Usage: grammarc [-v] <grammar> <header>
+
+    Reads the rules and the declared precedence relations, derives the
+    relations the rules allow and checks the declared ones against them,
+    then writes the relation table, the rules and the trie of their
+    handles as constexpr data for parser_rules.h. Any problem is reported
+    as "file:line: message" and fails the build; -v also lists every
+    conflict of the rules and the relation chosen for it.
+
+    Built and run on the host before dslgui, so it uses the standard
+    library only.
+*/
+
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+
+const std::string nonterminal = "E";
+const std::string bottom = "^";
+const std::string end_of_input = "$";
+
+constexpr std::size_t max_handle = 16;
+
+struct GrammarError : std::runtime_error {
+    int line;
+
+    GrammarError(int line, const std::string& message)
+        : std::runtime_error(message), line(line) {}
+};
+
+struct GrammarRule {
+    std::string name;
+    std::string type;
+    std::vector<std::string> handle;
+    int line;
+};
+
+struct DeclaredRelation {
+    std::string line;
+    std::string stack;
+    int relation;
+    int source_line;
+};
+
+struct Grammar {
+    std::string start;
+    std::vector<GrammarRule> rules;
+    std::vector<DeclaredRelation> relations;
+};
+
+/*!
+    What the rules allow for a (line, stack) pair: a shift (< or =),
+    a reduction (>) or both, which is a conflict.
+*/
+struct Derived {
+    bool shift = false;
+    bool reduce = false;
+};
+
+using Pair = std::pair<std::string, std::string>;
+
+bool is_terminal(const std::string& symbol) {
+    return symbol != nonterminal;
+}
+
+std::vector<std::string> split(const std::string& text) {
+    std::istringstream in(text);
+    std::vector<std::string> words;
+    for (std::string word; in >> word;)
+        words.push_back(word);
+    return words;
+}
+
+int parse_relation(const std::string& word, int line) {
+    if (word == "<")
+        return -1;
+    if (word == "=")
+        return 0;
+    if (word == ">")
+        return 1;
+    throw GrammarError(line, "expected <, = or > but found \"" + word + "\"");
+}
+
+Grammar read_grammar(std::istream& in) {
+    enum class Section { None, Rules, Relations } section = Section::None;
+    Grammar grammar;
+
+    // Relations may wrap, so they are collected as one stream of words.
+    std::vector<std::pair<std::string, int>> relation_words;
+
+    std::string text;
+    for (int line = 1; std::getline(in, text); line++) {
+        if (std::size_t comment = text.find('#'); comment != std::string::npos)
+            text.erase(comment);
+
+        std::vector<std::string> words = split(text);
+        if (words.empty())
+            continue;
+
+        if (words[0] == "%start") {
+            if (words.size() != 2)
+                throw GrammarError(line, "%start takes the name of one rule");
+            grammar.start = words[1];
+        }
+        else if (words[0] == "%rules" || words[0] == "%relations") {
+            if (words.size() != 1)
+                throw GrammarError(line, words[0] + " stands on a line of its own");
+            section = words[0] == "%rules" ? Section::Rules : Section::Relations;
+        }
+        else if (section == Section::Rules) {
+            if (words.size() < 4 || words[2] != ":")
+                throw GrammarError(line, "expected \"name TYPE : handle\"");
+
+            GrammarRule rule { words[0], words[1], {words.begin() + 3, words.end()}, line };
+            if (rule.handle.size() > max_handle)
+                throw GrammarError(line, "handle longer than " + std::to_string(max_handle) + " symbols");
+            grammar.rules.push_back(rule);
+        }
+        else if (section == Section::Relations) {
+            for (const std::string& word : words)
+                relation_words.push_back({word, line});
+        }
+        else
+            throw GrammarError(line, "expected %start, %rules or %relations");
+    }
+
+    std::string line_terminal;
+    for (std::size_t i = 0; i < relation_words.size();) {
+        const auto& [word, line] = relation_words[i];
+
+        if (i + 1 < relation_words.size() && relation_words[i + 1].first == ":") {
+            line_terminal = word;
+            i += 2;
+            continue;
+        }
+        if (line_terminal.empty())
+            throw GrammarError(line, "expected \"line : stack relation ...\"");
+        if (i + 1 == relation_words.size())
+            throw GrammarError(line, "relation to \"" + word + "\" is missing");
+
+        grammar.relations.push_back({line_terminal, word,
+                                     parse_relation(relation_words[i + 1].first,
+                                                    relation_words[i + 1].second),
+                                     line});
+        i += 2;
+    }
+
+    return grammar;
+}
+
+/*!
+    Checks what the parser takes for granted: every rule has a handle
+    of its own and no two nonterminals are ever next to each other, so
+    at most one E is above the topmost terminal of the stack.
+*/
+void check_rules(const Grammar& grammar) {
+    if (grammar.rules.empty())
+        throw GrammarError(0, "no rules");
+
+    std::map<std::vector<std::string>, const GrammarRule*> handles;
+    bool has_start = false;
+
+    for (const GrammarRule& rule : grammar.rules) {
+        if (rule.handle.size() == 1 && !is_terminal(rule.handle[0]))
+            throw GrammarError(rule.line, rule.name + " has no terminal");
+
+        for (std::size_t i = 0; i < rule.handle.size(); i++) {
+            const std::string& symbol = rule.handle[i];
+            if (symbol == bottom || symbol == end_of_input)
+                throw GrammarError(rule.line, "\"" + symbol + "\" cannot be part of a handle");
+            if (i > 0 && !is_terminal(symbol) && !is_terminal(rule.handle[i - 1]))
+                throw GrammarError(rule.line, "two nonterminals next to each other in " + rule.name);
+        }
+
+        auto [other, inserted] = handles.insert({rule.handle, &rule});
+        if (!inserted)
+            throw GrammarError(rule.line, rule.name + " has the same handle as " +
+                                              other->second->name);
+
+        has_start = has_start || rule.name == grammar.start;
+    }
+
+    if (!has_start)
+        throw GrammarError(0, "%start names no rule");
+}
+
+/*!
+    Derives the operator precedence relations of the rules. As the parser
+    compares terminals only, these are the Wirth-Weber relations with E
+    skipped: a terminal yields to the LEADING terminals of an E after it,
+    the TRAILING terminals of an E before a terminal take precedence over
+    it, and terminals of one handle with at most an E between them are
+    equal. The bottom yields to the start rule, whose end is reduced by
+    the end of the input, and the bottom and the end of the input around
+    the reduced program are equal.
+*/
+std::map<Pair, Derived> derive_relations(const Grammar& grammar) {
+    std::set<std::string> leading, trailing;
+    for (const GrammarRule& rule : grammar.rules) {
+        const auto& h = rule.handle;
+        if (is_terminal(h.front()))
+            leading.insert(h.front());
+        else if (h.size() > 1)
+            leading.insert(h[1]);
+
+        if (is_terminal(h.back()))
+            trailing.insert(h.back());
+        else if (h.size() > 1)
+            trailing.insert(h[h.size() - 2]);
+    }
+
+    std::map<Pair, Derived> derived;
+    auto put = [&](const std::string& line, const std::string& stack, int relation) {
+        Derived& pair = derived[{line, stack}];
+        (relation > 0 ? pair.reduce : pair.shift) = true;
+    };
+
+    for (const GrammarRule& rule : grammar.rules) {
+        const auto& h = rule.handle;
+        for (std::size_t i = 0; i + 1 < h.size(); i++) {
+            if (is_terminal(h[i]) && is_terminal(h[i + 1]))
+                put(h[i + 1], h[i], 0);
+            if (is_terminal(h[i]) && !is_terminal(h[i + 1])) {
+                if (i + 2 < h.size())
+                    put(h[i + 2], h[i], 0);
+                for (const std::string& next : leading)
+                    put(next, h[i], -1);
+            }
+            if (!is_terminal(h[i]) && is_terminal(h[i + 1]))
+                for (const std::string& previous : trailing)
+                    put(h[i + 1], previous, 1);
+        }
+
+        if (rule.name == grammar.start) {
+            put(is_terminal(h.front()) ? h.front() : h[1], bottom, -1);
+            put(end_of_input, is_terminal(h.back()) ? h.back() : h[h.size() - 2], 1);
+            put(end_of_input, bottom, 0);
+        }
+    }
+
+    return derived;
+}
+
+const char* relation_name(int relation) {
+    return relation < 0 ? "<" : relation == 0 ? "=" : ">";
+}
+
+/*!
+    Every declared relation has to be one the rules allow: a relation for
+    a pair the rules never produce is dead, a shift where the rules only
+    reduce (or the other way round) makes the parser miss handles. Returns
+    the number of conflicts of the rules the declarations resolve.
+*/
+int check_relations(const Grammar& grammar, const std::map<Pair, Derived>& derived,
+                    bool verbose) {
+    std::map<Pair, const DeclaredRelation*> declared;
+
+    for (const DeclaredRelation& r : grammar.relations) {
+        auto [other, inserted] = declared.insert({{r.line, r.stack}, &r});
+        if (!inserted)
+            throw GrammarError(r.source_line, "second relation for (" + r.line + ", " +
+                                                  r.stack + "), first on line " +
+                                                  std::to_string(other->second->source_line));
+
+        auto found = derived.find({r.line, r.stack});
+        if (found == derived.end())
+            throw GrammarError(r.source_line, "(" + r.line + ", " + r.stack +
+                                                  ") never occurs in a sentence of the rules");
+
+        bool reduce = r.relation > 0;
+        if (reduce ? !found->second.reduce : !found->second.shift)
+            throw GrammarError(r.source_line, "(" + r.line + ", " + r.stack + ") " +
+                                                  relation_name(r.relation) +
+                                                  " conflicts with the rules, which " +
+                                                  (reduce ? "shift" : "reduce") + " there");
+    }
+
+    int resolved = 0;
+    for (const auto& [pair, allowed] : derived) {
+        if (!allowed.shift || !allowed.reduce)
+            continue;
+
+        auto found = declared.find(pair);
+        resolved += found != declared.end();
+        if (verbose)
+            std::cout << "conflict (" << pair.first << ", " << pair.second << "): "
+                      << (found == declared.end() ? "syntax error"
+                                                  : relation_name(found->second->relation))
+                      << '\n';
+    }
+    return resolved;
+}
+
+std::string quoted(const std::string& text) {
+    return "\"" + text + "\"";
+}
+
+std::string symbol(const std::string& name) {
+    return "grammar::symbol(" + quoted(name) + ")";
+}
+
+/*!
+    Trie of the handles read backwards, as the parser reads the stack
+    from the top down. Node 0 is the root.
+*/
+struct Trie {
+    struct Edge {
+        std::size_t from;
+        std::string symbol;
+        std::size_t to;
+    };
+
+    std::vector<Edge> edges;
+    std::vector<int> rules { -1 };
+
+    explicit Trie(const std::vector<GrammarRule>& grammar_rules) {
+        std::map<std::pair<std::size_t, std::string>, std::size_t> next;
+
+        for (std::size_t r = 0; r < grammar_rules.size(); r++) {
+            const auto& handle = grammar_rules[r].handle;
+            std::size_t node = 0;
+
+            for (auto it = handle.rbegin(); it != handle.rend(); ++it) {
+                auto [found, inserted] = next.insert({{node, *it}, rules.size()});
+                if (inserted) {
+                    edges.push_back({node, *it, rules.size()});
+                    rules.push_back(-1);
+                }
+                node = found->second;
+            }
+            rules[node] = (int)r;
+        }
+    }
+};
+
+void write_header(std::ostream& out, const Grammar& grammar, const std::string& source) {
+    out << "// Generated by grammarc from " << source << ". Do not edit.\n"
+        << "// Included by parser_rules.h only.\n\n"
+        << "#ifndef GRAMMAR_TABLES_H\n"
+        << "#define GRAMMAR_TABLES_H\n\n"
+        << "namespace generated {\n\n";
+
+    out << "inline constexpr PrecedenceRelation relations[] = {\n";
+    for (const DeclaredRelation& r : grammar.relations)
+        out << "    {" << quoted(r.line) << ", " << quoted(r.stack) << ", " << r.relation << "},\n";
+    out << "};\n\n";
+
+    out << "inline constexpr Rule rules[] = {\n";
+    for (const GrammarRule& rule : grammar.rules) {
+        out << "    {" << quoted(rule.name) << ", RuleType::" << rule.type << ", "
+            << rule.handle.size() << ", {";
+        for (std::size_t i = 0; i < rule.handle.size(); i++)
+            out << (i ? ", " : "") << symbol(rule.handle[i]);
+        out << "}},\n";
+    }
+    out << "};\n\n";
+
+    Trie trie(grammar.rules);
+
+    out << "inline constexpr RuleTrieEdge rule_trie_edges[] = {\n";
+    for (const Trie::Edge& edge : trie.edges)
+        out << "    {" << edge.from << ", " << symbol(edge.symbol) << ", " << edge.to << "},\n";
+    out << "};\n\n";
+
+    out << "inline constexpr qint16 rule_trie_rules[] = {";
+    for (std::size_t i = 0; i < trie.rules.size(); i++)
+        out << (i % 16 ? " " : "\n    ") << trie.rules[i] << ",";
+    out << "\n};\n\n"
+        << "} // namespace generated\n\n"
+        << "#endif // GRAMMAR_TABLES_H\n";
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    bool verbose = argc > 1 && std::string(argv[1]) == "-v";
+    if (argc != 3 + verbose) {
+        std::cerr << "usage: grammarc [-v] <grammar> <header>\n";
+        return 2;
+    }
+
+    const std::string source = argv[1 + verbose];
+    const std::string header = argv[2 + verbose];
+
+    std::ifstream in(source);
+    if (!in) {
+        std::cerr << source << ": cannot open\n";
+        return 1;
+    }
+
+    try {
+        Grammar grammar = read_grammar(in);
+        check_rules(grammar);
+
+        std::map<Pair, Derived> derived = derive_relations(grammar);
+        int resolved = check_relations(grammar, derived, verbose);
+
+        int conflicts = 0;
+        for (const auto& [pair, allowed] : derived)
+            conflicts += allowed.shift && allowed.reduce;
+
+        std::ostringstream text;
+        write_header(text, grammar, source.substr(source.find_last_of("/\\") + 1));
+
+        std::ofstream out(header);
+        if (!(out << text.str())) {
+            std::cerr << header << ": cannot write\n";
+            return 1;
+        }
+
+        std::cout << "grammarc: " << grammar.rules.size() << " rules, "
+                  << grammar.relations.size() << " relations, " << conflicts
+                  << " conflicts of the rules (" << resolved << " resolved by a relation, "
+                  << conflicts - resolved << " left as syntax errors)\n";
+    }
+    catch (const GrammarError& e) {
+        std::cerr << source << ":" << e.line << ": " << e.what() << '\n';
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,451 @@
+#include "ir.h"
+#include "symbols.h"
+
+#include <QStringList>
+
+namespace ir {
+
+const char* opcode_name(Opcode op) {
+    switch (op) {
+    case Opcode::Const: return "const";
+    case Opcode::Copy: return "copy";
+    case Opcode::Neg: return "neg";
+    case Opcode::Add: return "add";
+    case Opcode::Sub: return "sub";
+    case Opcode::Mul: return "mul";
+    case Opcode::Div: return "div";
+    case Opcode::Phi: return "phi";
+    case Opcode::Input: return "input";
+    case Opcode::Output: return "output";
+    case Opcode::Jump: return "jump";
+    case Opcode::Branch: return "branch";
+    case Opcode::Return: return "return";
+    }
+    return "?";
+}
+
+Type result_type(Opcode op) {
+    switch (op) {
+    case Opcode::Output:
+    case Opcode::Jump:
+    case Opcode::Branch:
+    case Opcode::Return:
+        return Type::Void;
+    default:
+        return Type::I32;
+    }
+}
+
+bool is_terminator(Opcode op) {
+    return op == Opcode::Jump || op == Opcode::Branch || op == Opcode::Return;
+}
+
+bool has_side_effects(Opcode op) {
+    return op == Opcode::Input || op == Opcode::Output || is_terminator(op);
+}
+
+bool is_arithmetic(Opcode op) {
+    return op == Opcode::Neg || op == Opcode::Add || op == Opcode::Sub ||
+           op == Opcode::Mul || op == Opcode::Div;
+}
+
+void Function::clear() {
+    __values.clear();
+    __operands.clear();
+    __blocks.clear();
+}
+
+/*!
+    The block is labelled after its kind and number, like WHILE_COND_3,
+    which is also its label in the assembly.
+*/
+Block Function::add_block(const char* kind) {
+    const Block block = (Block)__blocks.size();
+    __blocks.push_back({});
+    __blocks.back().label = QString("%1_%2").arg(kind).arg(block);
+    return block;
+}
+
+Value Function::create(Opcode op, Block block, std::initializer_list<Value> operands) {
+    Instruction instruction;
+    instruction.op = op;
+    instruction.type = result_type(op);
+    instruction.block = block;
+    instruction.first_operand = (quint32)__operands.size();
+    instruction.operand_count = (quint16)operands.size();
+    __operands.insert(__operands.end(), operands.begin(), operands.end());
+
+    __values.push_back(instruction);
+    return (Value)__values.size() - 1;
+}
+
+Value Function::append(Block block, Opcode op, std::initializer_list<Value> operands) {
+    const Value value = create(op, block, operands);
+    __blocks[block].instructions.append(value);
+    return value;
+}
+
+Value Function::append_const(Block block, qint32 immediate) {
+    const Value value = append(block, Opcode::Const);
+    __values[value].immediate = immediate;
+    return value;
+}
+
+Value Function::prepend_const(Block block, qint32 immediate) {
+    const Value value = create(Opcode::Const, block, {});
+    __values[value].immediate = immediate;
+
+    QList<Value>& instructions = __blocks[block].instructions;
+    qsizetype at = 0;
+    while (at < instructions.size() && __values[instructions.at(at)].op == Opcode::Phi)
+        at++;
+    instructions.insert(at, value);
+    return value;
+}
+
+/*!
+    Phis go after the phis already in the block, before anything else.
+*/
+Value Function::add_phi(Block block, quint16 count) {
+    const Value value = create(Opcode::Phi, block, {});
+    __values[value].first_operand = (quint32)__operands.size();
+    __values[value].operand_count = count;
+    __operands.resize(__operands.size() + count, no_value);
+
+    QList<Value>& instructions = __blocks[block].instructions;
+    qsizetype at = 0;
+    while (at < instructions.size() && __values[instructions.at(at)].op == Opcode::Phi)
+        at++;
+    instructions.insert(at, value);
+    return value;
+}
+
+void Function::link(Block from, Block to) {
+    __blocks[from].successors.append(to);
+    __blocks[to].predecessors.append(from);
+}
+
+void Function::unlink(Block from, Block to) {
+    __blocks[from].successors.removeOne(to);
+    __blocks[to].predecessors.removeOne(from);
+}
+
+void Function::jump(Block from, Block to) {
+    const Value value = append(from, Opcode::Jump);
+    __values[value].targets[0] = to;
+    link(from, to);
+}
+
+/*!
+    if_false may be no_block and set later with set_target(), once the
+    block it goes to exists.
+*/
+void Function::branch(Block from, Value condition, Block if_true, Block if_false) {
+    const Value value = append(from, Opcode::Branch, {condition});
+    __values[value].targets[0] = if_true;
+    __values[value].targets[1] = if_false;
+    link(from, if_true);
+    if (if_false != no_block)
+        link(from, if_false);
+}
+
+void Function::set_target(Block from, int index, Block to) {
+    Instruction& instruction = __values[terminator(from)];
+    if (instruction.targets[index] != no_block)
+        unlink(from, instruction.targets[index]);
+    instruction.targets[index] = to;
+    link(from, to);
+}
+
+Value Function::terminator(Block block) const {
+    const QList<Value>& instructions = __blocks[block].instructions;
+    if (instructions.isEmpty() || !is_terminator(__values[instructions.last()].op))
+        return no_value;
+    return instructions.last();
+}
+
+void Function::compact() {
+    for (BasicBlock& block : __blocks)
+        block.instructions.removeIf([&](Value value) { return __values[value].erased; });
+}
+
+/*!
+    Replacements may chain, a phi replaced by a phi that is replaced in
+    turn; operands go to the end of the chain.
+*/
+void Function::replace_uses(const std::vector<Value>& replacement) {
+    auto resolve = [&](Value value) {
+        while (value != no_value && value < (Value)replacement.size() &&
+               replacement[value] != no_value)
+            value = replacement[value];
+        return value;
+    };
+
+    for (const Instruction& instruction : __values) {
+        if (instruction.erased)
+            continue;
+        for (quint32 i = 0; i < instruction.operand_count; i++) {
+            Value& operand = __operands[instruction.first_operand + i];
+            operand = resolve(operand);
+        }
+    }
+}
+
+/*!
+    One line per instruction, values as %n and blocks by label:
+
+        WHILE_COND_1:                               ; preds ENTRY_0, WHILE_BODY_2
+            %7 = phi %3, %12                        ; aa
+            branch %7, WHILE_BODY_2, WHILE_END_3
+*/
+QString Function::dump(const SymbolTable* names) const {
+    QString text;
+
+    auto value_name = [](Value value) {
+        return value == no_value ? QString("undef") : QString("%%1").arg(value);
+    };
+
+    for (const BasicBlock& block : __blocks) {
+        QString line = block.label + ":";
+        if (!block.predecessors.isEmpty()) {
+            QStringList predecessors;
+            for (Block predecessor : block.predecessors)
+                predecessors.append(__blocks[predecessor].label);
+            line = line.leftJustified(48) + "; preds " + predecessors.join(", ");
+        }
+        text += line + "\n";
+
+        for (Value value : block.instructions) {
+            const Instruction& instruction = at(value);
+            line = "    ";
+            if (instruction.type != Type::Void)
+                line += value_name(value) + " = ";
+            line += opcode_name(instruction.op);
+
+            QStringList operands;
+            if (instruction.op == Opcode::Const)
+                operands.append(QString::number(instruction.immediate));
+            for (qsizetype i = 0; i < instruction.operand_count; i++)
+                operands.append(value_name(operand(value, i)));
+            for (Block target : instruction.targets)
+                if (target != no_block)
+                    operands.append(__blocks[target].label);
+            if (!operands.isEmpty())
+                line += " " + operands.join(", ");
+
+            if (instruction.variable >= 0 && names)
+                line = line.leftJustified(48) + "; " + names->value(instruction.variable);
+            text += line + "\n";
+        }
+    }
+    return text;
+}
+
+namespace {
+
+/*!
+    Immediate dominators by the iterative algorithm of Cooper, Harvey and
+    Kennedy, over the blocks in reverse post order. Unreachable blocks get
+    no_block.
+*/
+std::vector<Block> dominators(const Function& function, std::vector<qsizetype>& order) {
+    const qsizetype count = function.block_count();
+    std::vector<Block> post_order;
+    std::vector<char> visited(count, 0);
+    std::vector<std::pair<Block, qsizetype>> stack;
+
+    if (count > 0) {
+        stack.push_back({0, 0});
+        visited[0] = 1;
+    }
+    while (!stack.empty()) {
+        auto& [block, next] = stack.back();
+        const QList<Block>& successors = function.block(block).successors;
+        if (next < successors.size()) {
+            const Block successor = successors.at(next++);
+            if (!visited[successor]) {
+                visited[successor] = 1;
+                stack.push_back({successor, 0});
+            }
+            continue;
+        }
+        post_order.push_back(block);
+        stack.pop_back();
+    }
+
+    order.assign(count, -1);
+    for (qsizetype i = 0; i < (qsizetype)post_order.size(); i++)
+        order[post_order[i]] = i;
+
+    std::vector<Block> idom(count, no_block);
+    if (count == 0)
+        return idom;
+    idom[0] = 0;
+
+    auto intersect = [&](Block a, Block b) {
+        while (a != b) {
+            while (order[a] < order[b])
+                a = idom[a];
+            while (order[b] < order[a])
+                b = idom[b];
+        }
+        return a;
+    };
+
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (auto it = post_order.rbegin(); it != post_order.rend(); ++it) {
+            const Block block = *it;
+            if (block == 0)
+                continue;
+            Block dominator = no_block;
+            for (Block predecessor : function.block(block).predecessors) {
+                if (idom[predecessor] == no_block)
+                    continue;
+                dominator = dominator == no_block ? predecessor : intersect(predecessor, dominator);
+            }
+            if (idom[block] != dominator) {
+                idom[block] = dominator;
+                changed = true;
+            }
+        }
+    }
+    return idom;
+}
+
+} // namespace
+
+/*!
+    Checks the structure (a terminator closing every block and nowhere
+    else, phis first, edges matching the terminators), the types of the
+    operands and that every value dominates its uses. Lowering also needs
+    that a block with phis is never entered by a branch.
+*/
+QList<QString> verify(const Function& function) {
+    QList<QString> errors;
+    auto error = [&](const BasicBlock& block, const QString& message) {
+        errors.append(QString("%1: %2").arg(block.label, message));
+    };
+
+    std::vector<qsizetype> order;
+    const std::vector<Block> idom = dominators(function, order);
+
+    // Entry and exit numbers of a walk of the dominator tree: a dominates
+    // b if b's interval is inside a's.
+    std::vector<std::vector<Block>> children(function.block_count());
+    for (Block b = 1; b < function.block_count(); b++)
+        if (idom[b] != no_block)
+            children[idom[b]].push_back(b);
+
+    std::vector<qsizetype> enter(function.block_count(), -1), exit(function.block_count(), -1);
+    std::vector<std::pair<Block, qsizetype>> walk;
+    qsizetype clock = 0;
+    if (function.block_count() > 0)
+        walk.push_back({0, 0});
+    while (!walk.empty()) {
+        auto [block, next] = walk.back();
+        if (next == 0)
+            enter[block] = clock++;
+        if (next < (qsizetype)children[block].size()) {
+            walk.back().second++;
+            walk.push_back({children[block][next], 0});
+            continue;
+        }
+        exit[block] = clock++;
+        walk.pop_back();
+    }
+
+    auto dominates = [&](Block a, Block b) {
+        return enter[a] <= enter[b] && exit[b] <= exit[a];
+    };
+
+    std::vector<qsizetype> position(function.size(), -1);
+    for (Block b = 0; b < function.block_count(); b++) {
+        const QList<Value>& instructions = function.block(b).instructions;
+        for (qsizetype i = 0; i < instructions.size(); i++)
+            position[instructions.at(i)] = i;
+    }
+
+    for (Block b = 0; b < function.block_count(); b++) {
+        const BasicBlock& block = function.block(b);
+
+        if (idom[b] == no_block) {
+            error(block, "unreachable");
+            continue;
+        }
+        if (function.terminator(b) == no_value) {
+            error(block, "does not end in a terminator");
+            continue;
+        }
+
+        // The edges have to be the terminator's targets.
+        const Instruction& terminator = function.at(function.terminator(b));
+        QList<Block> targets;
+        for (Block target : terminator.targets)
+            if (target != no_block)
+                targets.append(target);
+        if (targets != block.successors)
+            error(block, "successors do not match the terminator");
+        for (Block successor : block.successors)
+            if (!function.block(successor).predecessors.contains(b))
+                error(block, QString("missing from the predecessors of %1")
+                                 .arg(function.block(successor).label));
+
+        bool phis = true;
+        for (qsizetype i = 0; i < block.instructions.size(); i++) {
+            const Value value = block.instructions.at(i);
+            const Instruction& instruction = function.at(value);
+            const QString name = QString("%%1").arg(value);
+
+            if (instruction.erased)
+                error(block, name + " is erased");
+            if (instruction.block != b)
+                error(block, name + " belongs to another block");
+            if (instruction.type != result_type(instruction.op))
+                error(block, name + " has the wrong type");
+            if (is_terminator(instruction.op) && i != block.instructions.size() - 1)
+                error(block, name + " is a terminator in the middle of the block");
+
+            if (instruction.op == Opcode::Phi) {
+                if (!phis)
+                    error(block, name + " is a phi after other instructions");
+                if (instruction.operand_count != block.predecessors.size())
+                    error(block, name + " does not have an operand per predecessor");
+                for (Block predecessor : block.predecessors)
+                    if (function.block(predecessor).successors.size() != 1)
+                        error(block, name + " is reached by a branch from " +
+                                         function.block(predecessor).label);
+            }
+            else
+                phis = false;
+
+            for (qsizetype k = 0; k < instruction.operand_count; k++) {
+                const Value operand = function.operand(value, k);
+                if (operand < 0 || operand >= function.size() || function.at(operand).erased ||
+                    position[operand] < 0) {
+                    error(block, QString("%1 uses an undefined value").arg(name));
+                    continue;
+                }
+                const Instruction& definition = function.at(operand);
+                if (definition.type != Type::I32)
+                    error(block, QString("%1 uses %%2, which has no value").arg(name).arg(operand));
+
+                // A phi uses its operand at the end of the matching predecessor.
+                if (instruction.op == Opcode::Phi) {
+                    if (k < block.predecessors.size() &&
+                        !dominates(definition.block, block.predecessors.at(k)))
+                        error(block, QString("%1 uses %%2, which does not dominate %3")
+                                         .arg(name).arg(operand)
+                                         .arg(function.block(block.predecessors.at(k)).label));
+                }
+                else if (definition.block == b ? position[operand] >= i
+                                               : !dominates(definition.block, b))
+                    error(block, QString("%1 uses %%2 before it is defined").arg(name).arg(operand));
+            }
+        }
+    }
+    return errors;
+}
+
+} // namespace ir
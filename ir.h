@@ -0,0 +1,141 @@
+#ifndef IR_H
+#define IR_H
+
+#include <QList>
+#include <QString>
+#include <QtGlobal>
+
+#include <initializer_list>
+#include <vector>
+
+class SymbolTable;
+
+/*!
+    Three-address SSA form of a program, between the syntax tree and the
+    x86 code. Every instruction defines at most one value and is that
+    value: Value is the instruction's index in its Function. Instructions
+    live in basic blocks that end in exactly one terminator; a phi at the
+    start of a block picks one operand per predecessor, in the order of
+    the block's predecessors.
+*/
+namespace ir {
+
+enum class Type : quint8 {
+    Void,
+    I32,
+};
+
+enum class Opcode : quint8 {
+    Const,      // immediate
+    Copy,       // operand 0
+    Neg,
+    Add,
+    Sub,
+    Mul,
+    Div,        // truncating, like idiv
+    Phi,
+    Input,      // reads a number from stdin
+    Output,     // writes operand 0 to stdout
+    Jump,       // to target 0
+    Branch,     // to target 0 if operand 0 is not 0, else to target 1
+    Return,
+};
+
+using Value = qint32;
+using Block = qint32;
+
+constexpr Value no_value = -1;
+constexpr Block no_block = -1;
+
+const char* opcode_name(Opcode op);
+Type result_type(Opcode op);
+bool is_terminator(Opcode op);
+//! Has to stay even if its value is not used.
+bool has_side_effects(Opcode op);
+bool is_arithmetic(Opcode op);
+
+struct Instruction {
+    Opcode op;
+    Type type;
+    bool erased = false;
+    quint16 operand_count = 0;
+    quint32 first_operand = 0;  // in the operand pool of the Function
+    Block block = no_block;
+    qint32 variable = -1;       // symbol of the variable the value is a version of
+    qint32 immediate = 0;       // of a Const
+    Block targets[2] = {no_block, no_block};
+    qint32 first_token = -1;    // source the instruction was made from, for comments
+    qint32 last_token = -1;
+};
+
+struct BasicBlock {
+    QString label;
+    QList<Value> instructions;  // phis first, a terminator last
+    QList<Block> predecessors;
+    QList<Block> successors;
+};
+
+/*!
+    One program in SSA form. Blocks are laid out in the order they were
+    added, which the builder keeps in source order, and block 0 is the
+    entry. Operands of all instructions share one pool, so building a
+    function allocates little; erase() only marks an instruction and
+    compact() drops the marked ones from their blocks.
+*/
+class Function {
+    std::vector<Instruction> __values;
+    std::vector<Value> __operands;
+    std::vector<BasicBlock> __blocks;
+
+    Value create(Opcode op, Block block, std::initializer_list<Value> operands);
+    void link(Block from, Block to);
+    void unlink(Block from, Block to);
+
+public:
+    Function() = default;
+
+    void clear();
+
+    Block add_block(const char* kind);
+
+    Value append(Block block, Opcode op, std::initializer_list<Value> operands = {});
+    Value append_const(Block block, qint32 immediate);
+    Value prepend_const(Block block, qint32 immediate);
+    //! A phi with count operands, all no_value until set_operand().
+    Value add_phi(Block block, quint16 count);
+
+    void jump(Block from, Block to);
+    void branch(Block from, Value condition, Block if_true, Block if_false);
+    //! Points target index of the terminator of from at to.
+    void set_target(Block from, int index, Block to);
+
+    qsizetype size() const { return (qsizetype)__values.size(); }
+    const Instruction& at(Value value) const { return __values[value]; }
+    Instruction& at(Value value) { return __values[value]; }
+
+    qsizetype operand_count(Value value) const { return __values[value].operand_count; }
+    Value operand(Value value, qsizetype index) const {
+        return __operands[__values[value].first_operand + index];
+    }
+    void set_operand(Value value, qsizetype index, Value to) {
+        __operands[__values[value].first_operand + index] = to;
+    }
+
+    qsizetype block_count() const { return (qsizetype)__blocks.size(); }
+    const BasicBlock& block(Block block) const { return __blocks[block]; }
+    Value terminator(Block block) const;
+
+    void erase(Value value) { __values[value].erased = true; }
+    void compact();
+    //! Every operand v becomes replacement[v] where that is not no_value.
+    void replace_uses(const std::vector<Value>& replacement);
+
+    QString dump(const SymbolTable* names = nullptr) const;
+};
+
+//! What is wrong with the function, nothing if it is well formed.
+QList<QString> verify(const Function& function);
+
+} // namespace ir
+
+#endif // IR_H
@@ -0,0 +1,350 @@
+#include "irbuilder.h"
+
+#include <stdexcept>
+
+namespace ir {
+
+namespace {
+
+constexpr quint8 semicolon_symbol = grammar::symbol(";");
+constexpr quint8 plus_symbol = grammar::symbol("+");
+constexpr quint8 minus_symbol = grammar::symbol("-");
+constexpr quint8 mul_symbol = grammar::symbol("*");
+constexpr quint8 div_symbol = grammar::symbol("/");
+
+//! Labels of the condition, body and exit blocks of a loop.
+constexpr const char* while_blocks[] = {"WHILE_COND", "WHILE_BODY", "WHILE_END"};
+constexpr const char* for_blocks[] = {"FOR_COND", "FOR_BODY", "FOR_END"};
+
+} // namespace
+
+Lexema Builder::tokenOf(qsizetype node) const {
+    return __lexer->get_tokenized_code().at(__ast->at(node).first);
+}
+
+//! The operator of a binary rule, like "+" in "E + E".
+quint8 Builder::operatorOf(qsizetype node) const {
+    return rules[__ast->at(node).rule].handle[1];
+}
+
+//! Steps down through "( E )" and the unit rule from an atom to E.
+qsizetype Builder::unwrap(qsizetype node) const {
+    while (__ast->at(node).children == 1 &&
+           (__ast->at(node).type == RuleType::E || __ast->at(node).type == RuleType::EXPR))
+        node++;
+    return node;
+}
+
+bool Builder::isSequence(qsizetype node) const {
+    const AstNode& n = __ast->at(node);
+    return n.type == RuleType::E && n.children == 2 && operatorOf(node) == semicolon_symbol;
+}
+
+//! Symbol of the variable a leaf is, throws if it is a const.
+qint32 Builder::variableOf(qsizetype node, const char* what) const {
+    if (!isLeaf(node) || tokenOf(node).type() != TokenType::Id)
+        fail(node, QString("%1 needs a variable").arg(what));
+    return tokenOf(node).symbol();
+}
+
+void Builder::fail(qsizetype node, const QString& message) const {
+    throw std::runtime_error(QString("%1: %2")
+        .arg(__lexer->get_source()->location(tokenOf(node).offset()), message)
+        .toStdString());
+}
+
+void Builder::setSource(Value value, qsizetype node) {
+    __function->at(value).first_token = __ast->at(node).first;
+    __function->at(value).last_token = __ast->at(node).last;
+}
+
+void Builder::build(Function& function) {
+    __function = &function;
+    __function->clear();
+    __current.assign(__lexer->get_ids().size(), no_value);
+    __seen.assign(__lexer->get_ids().size(), 0);
+    __stamp = 0;
+    __log.clear();
+    __zero = no_value;
+
+    __block = __function->add_block("ENTRY");
+    if (!__ast->isEmpty())
+        statement(0);
+    __function->append(__block, Opcode::Return);
+}
+
+/*!
+    A variable nothing was assigned to yet is 0, from a constant at the
+    start of the entry block, which dominates every use.
+*/
+Value Builder::read(qint32 symbol) {
+    if (__current[symbol] != no_value)
+        return __current[symbol];
+    if (__zero == no_value)
+        __zero = __function->prepend_const(0, 0);
+    return __zero;
+}
+
+void Builder::assign(qint32 symbol, Value value) {
+    __log.push_back({symbol, __current[symbol]});
+    __current[symbol] = value;
+}
+
+/*!
+    Takes back the assignments made since the undo log was mark long and
+    returns the value each variable they assigned had at the end, once
+    per variable.
+*/
+std::vector<Builder::Assignment> Builder::undo(qsizetype mark) {
+    std::vector<Assignment> assigned;
+    __stamp++;
+    for (qsizetype i = mark; i < (qsizetype)__log.size(); i++) {
+        const qint32 symbol = __log[i].symbol;
+        if (__seen[symbol] != __stamp) {
+            __seen[symbol] = __stamp;
+            assigned.push_back({symbol, __current[symbol]});
+        }
+    }
+
+    while ((qsizetype)__log.size() > mark) {
+        __current[__log.back().symbol] = __log.back().value;
+        __log.pop_back();
+    }
+    return assigned;
+}
+
+//! The variables the statements from first to its sibling last assign to, once each.
+std::vector<qint32> Builder::assignedIn(qsizetype first, qsizetype last) {
+    std::vector<qint32> symbols;
+    __stamp++;
+    for (qsizetype i = first; i < __ast->next_sibling(last); i++) {
+        const RuleType type = __ast->at(i).type;
+        if (type != RuleType::LET && type != RuleType::IN)
+            continue;
+        const qsizetype target = unwrap(i + 1);
+        if (!isLeaf(target) || tokenOf(target).type() != TokenType::Id)
+            continue;
+        const qint32 symbol = tokenOf(target).symbol();
+        if (__seen[symbol] != __stamp) {
+            __seen[symbol] = __stamp;
+            symbols.push_back(symbol);
+        }
+    }
+    return symbols;
+}
+
+void Builder::statement(qsizetype node) {
+    // "E ; E" nests to the right, so a block is walked as a loop.
+    while (isSequence(node)) {
+        statement(node + 1);
+        node = __ast->next_sibling(node + 1);
+    }
+
+    switch (__ast->at(node).type) {
+    case RuleType::PROGRAM:
+        // program a E begin E end .
+        statement(__ast->next_sibling(__ast->next_sibling(node + 1)));
+        break;
+    case RuleType::BLOCK:
+        statement(node + 1);
+        break;
+    case RuleType::LET:
+        assignment(node);
+        break;
+    case RuleType::IN: {
+        const qint32 symbol = variableOf(unwrap(node + 1), "input");
+        const Value value = __function->append(__block, Opcode::Input);
+        __function->at(value).variable = symbol;
+        setSource(value, node);
+        assign(symbol, value);
+        break;
+    }
+    case RuleType::OUT: {
+        const Value value = __function->append(__block, Opcode::Output, {expression(node + 1)});
+        setSource(value, node);
+        break;
+    }
+    case RuleType::IF:
+    case RuleType::IF_ELSE:
+        ifStatement(node);
+        break;
+    case RuleType::WHILE: {
+        const qsizetype condition = node + 1;
+        loop(condition, __ast->next_sibling(condition), -1, while_blocks);
+        break;
+    }
+    case RuleType::FOR: {
+        // for (init; condition; increment) body: init and increment are
+        // statements too, input() in either reads
+        statement(node + 1);
+        const qsizetype condition = __ast->next_sibling(node + 1);
+        const qsizetype increment = __ast->next_sibling(condition);
+        loop(condition, __ast->next_sibling(increment), increment, for_blocks);
+        break;
+    }
+    default:
+        // Declarations, and expressions, which have no side effects
+        break;
+    }
+}
+
+/*!
+    The value of the expression becomes the new version of the variable;
+    a value that already is something else, a const or another version,
+    is copied first.
+*/
+void Builder::assignment(qsizetype node) {
+    const qsizetype target = node + 1;
+    const qint32 symbol = variableOf(target, "let");
+
+    const Value created = __function->size();
+    Value value = expression(__ast->next_sibling(target));
+    if (value < created || __function->at(value).op == Opcode::Const)
+        value = __function->append(__block, Opcode::Copy, {value});
+
+    __function->at(value).variable = symbol;
+    setSource(value, node);
+    assign(symbol, value);
+}
+
+void Builder::ifStatement(qsizetype node) {
+    const qsizetype condition = node + 1;
+    const qsizetype then_branch = __ast->next_sibling(condition);
+
+    const Value test = expression(condition);
+    const Block then_block = __function->add_block("IF_THEN");
+    __function->branch(__block, test, then_block, no_block);
+    setSource(__function->terminator(__block), condition);
+    const Block branch_block = __block;
+
+    const qsizetype mark = (qsizetype)__log.size();
+    __block = then_block;
+    statement(then_branch);
+    const Block then_end = __block;
+    const std::vector<Assignment> then_values = undo(mark);
+
+    // An if without else still gets its else block, so the block after
+    // the if is never entered by a branch.
+    const Block else_block = __function->add_block("ELSE");
+    __function->set_target(branch_block, 1, else_block);
+    __block = else_block;
+    if (__ast->at(node).type == RuleType::IF_ELSE)
+        statement(__ast->next_sibling(then_branch));
+    const Block else_end = __block;
+    const std::vector<Assignment> else_values = undo(mark);
+
+    const Block end = __function->add_block("END_IF");
+    __function->jump(then_end, end);
+    __function->jump(else_end, end);
+    __block = end;
+
+    // A phi for every variable either branch assigned, in the order of the
+    // predecessors: then first.
+    auto join = [&](qint32 symbol, Value then_value, Value else_value) {
+        const Value phi = __function->add_phi(end, 2);
+        __function->set_operand(phi, 0, then_value);
+        __function->set_operand(phi, 1, else_value);
+        __function->at(phi).variable = symbol;
+        assign(symbol, phi);
+    };
+
+    __stamp++;
+    for (const Assignment& assigned : then_values)
+        __seen[assigned.symbol] = __stamp;
+    for (const Assignment& assigned : else_values)
+        if (__seen[assigned.symbol] != __stamp)
+            join(assigned.symbol, read(assigned.symbol), assigned.value);
+
+    for (const Assignment& assigned : then_values) {
+        Value else_value = read(assigned.symbol);
+        for (const Assignment& other : else_values)
+            if (other.symbol == assigned.symbol)
+                else_value = other.value;
+        join(assigned.symbol, assigned.value, else_value);
+    }
+}
+
+/*!
+    The condition block is entered from the block before the loop and
+    from the end of the body, in that order, and every variable the body
+    assigns gets a phi of the two there. After the loop the variables
+    have the values of the phis. The increment of a for, -1 for a while,
+    runs at the end of the body; it is the sibling right before the body.
+*/
+void Builder::loop(qsizetype condition, qsizetype body, qsizetype increment,
+                   const char* const (&kinds)[3]) {
+    const std::vector<qint32> assigned = assignedIn(increment < 0 ? body : increment, body);
+
+    std::vector<Value> entry_values;
+    entry_values.reserve(assigned.size());
+    for (qint32 symbol : assigned)
+        entry_values.push_back(read(symbol));
+
+    const Block header = __function->add_block(kinds[0]);
+    __function->jump(__block, header);
+    __block = header;
+
+    std::vector<Value> phis;
+    phis.reserve(assigned.size());
+    for (qsizetype i = 0; i < (qsizetype)assigned.size(); i++) {
+        const Value phi = __function->add_phi(header, 2);
+        __function->set_operand(phi, 0, entry_values[i]);
+        __function->at(phi).variable = assigned[i];
+        assign(assigned[i], phi);
+        phis.push_back(phi);
+    }
+
+    const qsizetype mark = (qsizetype)__log.size();
+    const Value test = expression(condition);
+    const Block body_block = __function->add_block(kinds[1]);
+    __function->branch(header, test, body_block, no_block);
+    setSource(__function->terminator(header), condition);
+
+    __block = body_block;
+    statement(body);
+    if (increment >= 0)
+        statement(increment);
+    for (qsizetype i = 0; i < (qsizetype)assigned.size(); i++)
+        __function->set_operand(phis[i], 1, read(assigned[i]));
+    __function->jump(__block, header);
+    undo(mark);
+
+    const Block exit = __function->add_block(kinds[2]);
+    __function->set_target(header, 1, exit);
+    __block = exit;
+}
+
+Value Builder::expression(qsizetype node) {
+    node = unwrap(node);
+    const AstNode& expr = __ast->at(node);
+
+    if (isLeaf(node)) {
+        const Lexema token = tokenOf(node);
+        if (token.type() == TokenType::Const)
+            return __function->append_const(__block, token.value().toInt());
+        return read(token.symbol());
+    }
+    if (expr.type == RuleType::NEG)
+        return __function->append(__block, Opcode::Neg, {expression(node + 1)});
+    if (expr.type != RuleType::EXPR || expr.children != 2)
+        fail(node, "Expression expected");
+
+    const qsizetype left = node + 1;
+    const Value a = expression(left);
+    const Value b = expression(__ast->next_sibling(left));
+
+    switch (operatorOf(node)) {
+    case plus_symbol:
+        return __function->append(__block, Opcode::Add, {a, b});
+    case minus_symbol:
+        return __function->append(__block, Opcode::Sub, {a, b});
+    case mul_symbol:
+        return __function->append(__block, Opcode::Mul, {a, b});
+    case div_symbol:
+        return __function->append(__block, Opcode::Div, {a, b});
+    default:
+        fail(node, "Expression expected");
+    }
+}
+
+} // namespace ir
@@ -0,0 +1,79 @@
+#ifndef IRBUILDER_H
+#define IRBUILDER_H
+
+#include "ast.h"
+#include "ir.h"
+#include "lexer.h"
+
+#include <vector>
+
+namespace ir {
+
+/*!
+    Builds the SSA form of a parsed program from its syntax tree.
+
+    The current value of every variable is kept in a table indexed by its
+    symbol, with an undo log of what each assignment replaced, the way
+    VariableTable keeps its scopes. The control flow of the language is
+    structured, so phis go where the structure says: at the end of an if
+    the branches are undone one after the other to see which variables
+    they assigned and a phi joins the two values of each; a loop gets a
+    phi in its condition block for every variable its body assigns,
+    before the body is built. Variables read before any assignment are 0,
+    like the zeroed .bss they used to live in.
+
+    Every value a let or an input produces is a version of its variable,
+    a Copy where the value would otherwise be another variable's, so the
+    versions of one variable are never live at once and the lowering can
+    keep them all in the variable's slot.
+*/
+class Builder {
+    struct Assignment {
+        qint32 symbol;
+        Value value;
+    };
+
+    const Lexer* __lexer;
+    const Ast* __ast;
+    Function* __function = nullptr;
+    Block __block = no_block;
+    Value __zero = no_value;
+
+    std::vector<Value> __current;           // value of each variable, by symbol
+    std::vector<Assignment> __log;          // symbol and the value it had before
+    std::vector<quint32> __seen;            // stamp per symbol
+    quint32 __stamp = 0;
+
+    // Tree helpers
+    Lexema tokenOf(qsizetype node) const;
+    bool isLeaf(qsizetype node) const { return __ast->at(node).rule < 0; }
+    quint8 operatorOf(qsizetype node) const;
+    qsizetype unwrap(qsizetype node) const;
+    bool isSequence(qsizetype node) const;
+    qint32 variableOf(qsizetype node, const char* what) const;
+    [[noreturn]] void fail(qsizetype node, const QString& message) const;
+
+    // Variables
+    Value read(qint32 symbol);
+    void assign(qint32 symbol, Value value);
+    std::vector<Assignment> undo(qsizetype mark);
+    std::vector<qint32> assignedIn(qsizetype first, qsizetype last);
+
+    void statement(qsizetype node);
+    void assignment(qsizetype node);
+    void ifStatement(qsizetype node);
+    void loop(qsizetype condition, qsizetype body, qsizetype increment,
+              const char* const (&kinds)[3]);
+    Value expression(qsizetype node);
+
+    void setSource(Value value, qsizetype node);
+
+public:
+    Builder(const Lexer* lexer, const Ast* ast) : __lexer(lexer), __ast(ast) {}
+
+    void build(Function& function);
+};
+
+} // namespace ir
+
+#endif // IRBUILDER_H
@@ -1,159 +1,752 @@
 #include "lexer.h"
 
+#include "scan.h"
+
+#include <QThread>
+
+#include <array>
+#include <cstring>
+#include <exception>
+#include <thread>
+
 /*!
+    Maps the file as the source.
     Returns true if file exists, false otherwise.
 */
 bool Lexer::loadFile(QString filename) {
-    QFile tmp = QFile(filename);
-
-    if (tmp.exists())
-    {
-        is_reading_from_file = true;
-        source_code = filename;
-        return 1;
-    }
-
-    return 0;
+    return loadSource(SourceBuffer::fromFile(filename));
 }
 
 /*!
     Returns true no matter what.
 */
 bool Lexer::loadText(QString& text) {
-    is_reading_from_file = false;
-    source_code = text;
+    return loadSource(SourceBuffer::fromText(text));
+}
+
+/*!
+    Uses an already loaded buffer, e.g. the one shown in the editor.
+    Returns false if there is no buffer.
+*/
+bool Lexer::loadSource(QSharedPointer<const SourceBuffer> buffer) {
+    if (buffer.isNull())
+        return 0;
+
+    source = buffer;
     return 1;
 }
 
+namespace {
+
+/*!
+    Character classes of the scanner. Every byte of the source maps to
+    exactly one of them through char_classes.
+*/
+enum CharClass : quint8 {
+    C_WS,       // ' ', '\n', '\t', '\r', '\0'
+    C_ALNUM,    // letters and digits
+    C_DELIM,    // delimeters except '/' and '*'
+    C_SLASH,    // '/', may open a comment
+    C_STAR,     // '*', may close a comment
+    C_OTHER,    // anything else, non-ASCII bytes are resolved by scan::utf8_word_char
+    C_COUNT
+};
+
+/*!
+    States of the scanner DFA.
+*/
+enum ScanState : quint8 {
+    S_START,        // between tokens
+    S_WORD,         // inside an identifier/number run
+    S_SLASH,        // after '/', comment not decided yet
+    S_COMMENT,      // inside /* */
+    S_COMMENT_STAR, // inside /* */ right after '*'
+    S_RECOVER,      // skipping a malformed token up to the next delimeter
+    S_COUNT
+};
+
+/*!
+    Actions attached to a transition, performed in declaration order.
+*/
+enum ScanAction : quint8 {
+    A_NONE = 0,
+    A_EMIT_WORD = 0b1,   // emit the word started at word_begin
+    A_EMIT_SLASH = 0b10, // emit the pending '/' as a delimeter
+    A_EMIT_DELIM = 0b100,// emit the current byte as a delimeter
+    A_MARK = 0b1000,     // a word starts at the current byte
+    A_ERROR = 0b10000,   // the current byte is an unknown character
+    A_COMMENT = 0b100000,// a comment opened at the pending '/'
+};
+
+struct Transition {
+    quint8 next;
+    quint8 actions;
+};
+
+constexpr std::array<quint8, 256> make_char_classes() {
+    std::array<quint8, 256> table {};
+
+    for (int c = 0; c < 256; c++)
+        table[c] = C_OTHER;
+
+    for (int c = '0'; c <= '9'; c++) table[c] = C_ALNUM;
+    for (int c = 'a'; c <= 'z'; c++) table[c] = C_ALNUM;
+    for (int c = 'A'; c <= 'Z'; c++) table[c] = C_ALNUM;
+
+    for (char c : {' ', '\n', '\t', '\r', '\0'})
+        table[(quint8)c] = C_WS;
+    for (char c : {'.', ',', ';', '+', '-', '(', ')', '='})
+        table[(quint8)c] = C_DELIM;
+
+    table['/'] = C_SLASH;
+    table['*'] = C_STAR;
+
+    return table;
+}
+
+constexpr std::array<quint8, 256> char_classes = make_char_classes();
+
+constexpr Transition transitions[S_COUNT][C_COUNT] = {
+    // S_START
+    {
+        {S_START, A_NONE},                      // C_WS
+        {S_WORD, A_MARK},                       // C_ALNUM
+        {S_START, A_EMIT_DELIM},                // C_DELIM
+        {S_SLASH, A_NONE},                      // C_SLASH
+        {S_START, A_EMIT_DELIM},                // C_STAR
+        {S_RECOVER, A_ERROR},                   // C_OTHER
+    },
+    // S_WORD
+    {
+        {S_START, A_EMIT_WORD},
+        {S_WORD, A_NONE},
+        {S_START, A_EMIT_WORD | A_EMIT_DELIM},
+        {S_SLASH, A_EMIT_WORD},
+        {S_START, A_EMIT_WORD | A_EMIT_DELIM},
+        {S_RECOVER, A_ERROR},
+    },
+    // S_SLASH
+    {
+        {S_START, A_EMIT_SLASH},
+        {S_WORD, A_EMIT_SLASH | A_MARK},
+        {S_START, A_EMIT_SLASH | A_EMIT_DELIM},
+        {S_SLASH, A_EMIT_SLASH},
+        {S_COMMENT, A_COMMENT},
+        {S_RECOVER, A_ERROR | A_EMIT_SLASH},
+    },
+    // S_COMMENT
+    {
+        {S_COMMENT, A_NONE},
+        {S_COMMENT, A_NONE},
+        {S_COMMENT, A_NONE},
+        {S_COMMENT, A_NONE},
+        {S_COMMENT_STAR, A_NONE},
+        {S_COMMENT, A_NONE},
+    },
+    // S_COMMENT_STAR
+    {
+        {S_COMMENT, A_NONE},
+        {S_COMMENT, A_NONE},
+        {S_COMMENT, A_NONE},
+        {S_START, A_NONE},
+        {S_COMMENT_STAR, A_NONE},
+        {S_COMMENT, A_NONE},
+    },
+    // S_RECOVER, the rest of a malformed token is dropped
+    {
+        {S_START, A_NONE},
+        {S_RECOVER, A_NONE},
+        {S_START, A_EMIT_DELIM},
+        {S_SLASH, A_NONE},
+        {S_START, A_EMIT_DELIM},
+        {S_RECOVER, A_NONE},
+    },
+};
+
+} // namespace
+
+/*!
+    Clears the results of a previous run.
+*/
+void Lexer::reset() {
+    revision++;
+    tokenized_source = nullptr;
+    tokenized_code.clear();
+    diagnostics.clear();
+    for (auto& table : token_tables)
+        table.clear();
+
+    if (source.isNull())
+        throw std::runtime_error("NoSourceLoadedError");
+
+    tokenized_code.set_source(source->data());
+}
+
 /*!
     Performs lexical analysis.
+    The whole source is scanned in a single forward pass by a table-driven
+    DFA directly over the mapped SourceBuffer; tokens are views into it.
+    Whitespace and word runs are skipped by the vectorized scan kernels.
     Result are stored in token_tables and tokenized_code.
+    Errors either throw, or with set_collect_diagnostics(true) are stored
+    in diagnostics while the scan goes on.
     Returns true if no errors occured, false otherwise.
 */
 bool Lexer::analyze() {
-    tokenized_code.clear();
-    token_tables.clear();
+    reset();
+
+    ScanContext context;
+    scan(source->data(), source->data() + source->size(), context, tokenized_code);
+    finish_scan(context, tokenized_code);
 
-    QTextStream in;
-    QFile* code;
-    if (is_reading_from_file) {
-        code = new QFile(source_code);
-        code->open(QIODeviceBase::ReadOnly | QIODeviceBase::Text);
-        in.setDevice(code);
+    tokenized_source = source.data();
+    return diagnostics.isEmpty();
+}
+
+/*!
+    Either records the error or throws it, depending on the mode.
+*/
+void Lexer::report(qsizetype offset, qsizetype length, const QString& message) {
+    if (!collect_diagnostics)
+        throw std::runtime_error(message.toStdString());
+
+    diagnostics.push_back({(quint32)offset, (quint32)length, message});
+}
+
+namespace {
+
+/*!
+    Splits [begin, end) into at most parts chunks of roughly equal size.
+    Every chunk but the first starts right after a ';' outside of a
+    comment, where the DFA is always back in S_START.
+    Returns the chunk starts, followed by end.
+*/
+QList<const char*> split_points(const char* begin, const char* end, int parts) {
+    QList<const char*> points = {begin};
+    const qsizetype step = (end - begin) / parts;
+    const char* target = begin + step;
+    quint8 state = S_START;
+
+    for (const char* p = begin; p < end && points.size() < parts; p++) {
+        const char c = *p;
+
+        switch (state) {
+        case S_START:
+        case S_SLASH:
+            if (c == '*' && state == S_SLASH)
+                state = S_COMMENT;
+            else if (c == '/')
+                state = S_SLASH;
+            else {
+                state = S_START;
+                if (c == ';' && p >= target) {
+                    points.push_back(p + 1);
+                    target = p + 1 + step;
+                }
+            }
+            break;
+        case S_COMMENT: {
+            const void* star = memchr(p, '*', end - p);
+            p = star ? static_cast<const char*>(star) : end - 1;
+            state = S_COMMENT_STAR;
+            break;
+        }
+        case S_COMMENT_STAR:
+            state = c == '/' ? S_START : c == '*' ? S_COMMENT_STAR : S_COMMENT;
+            break;
+        }
     }
-    else {
-        in.setString(&source_code, QIODeviceBase::ReadOnly);
-    }
-
-    QChar ch;
-    QString word;
-    Lexema cand;
-    QChar s1, s2;
-
-    while (!in.atEnd()) {
-        ch = in.read(1).at(0);
-
-        switch ([&]()->int{
-            if (ch == ' ' || ch == '\n' || ch == '\t' ||
-                ch == '\0' || ch == '\r')
-                return 0;
-            else if (ch.isDigit() || ch.isLetter())
-                return 1;
-            else if (ch == '.' || ch == ',' || ch == ';' ||
-                     ch == '+' || ch == '-' || ch =='/' ||
-                     ch == '*' || ch == '(' || ch == ')' ||
-                     ch == '=')
-                return 2;
-            else
-                return 3;
-        }()) {
-        case 0:
-            if (word.length() == 0)
-                goto nextcycle;
 
-            cand = Lexema(word);
-            if (cand.type() == TokenType::Error)
-                throw std::runtime_error(QString("Invalid token: %1").arg(cand.value()).toStdString());
+    points.push_back(end);
+    return points;
+}
+
+} // namespace
+
+/*!
+    Performs lexical analysis on several threads.
+    The source is cut at safe ';' boundaries and each chunk is lexed by
+    its own Lexer. Symbol tables are then merged in chunk order and token
+    symbols remapped, so the result is identical to analyze(), including
+    which error is reported first.
+    threads = 0 uses every core; small sources are lexed serially.
+*/
+bool Lexer::analyze_parallel(int threads) {
+    constexpr qsizetype min_chunk = 256 * 1024;
+
+    if (threads <= 0)
+        threads = QThread::idealThreadCount();
+    if (source.isNull() || threads <= 1 || source->size() < 2 * min_chunk)
+        return analyze();
+
+    reset();
+
+    const char* begin = source->data();
+    const char* end = begin + source->size();
+    QList<const char*> points = split_points(
+        begin, end, (int)qMin<qsizetype>(threads, source->size() / min_chunk));
+    const qsizetype chunks = points.size() - 1;
+
+    std::vector<Lexer> parts(chunks);
+    for (auto& part : parts)
+        part.collect_diagnostics = collect_diagnostics;
+    std::vector<std::exception_ptr> errors(chunks);
+    std::vector<std::thread> workers;
+
+    auto run = [&](auto&& job) {
+        workers.clear();
+        for (qsizetype i = 0; i < chunks; i++)
+            workers.emplace_back([&, i]() {
+                try {
+                    job(i);
+                } catch (...) {
+                    errors[i] = std::current_exception();
+                }
+            });
+        for (auto& worker : workers)
+            worker.join();
+
+        for (auto& error : errors)
+            if (error)
+                std::rethrow_exception(error);
+    };
+
+    run([&](qsizetype i) {
+        ScanContext context;
+        context.offset = points[i] - begin;
+        parts[i].scan(points[i], points[i + 1], context, parts[i].tokenized_code);
+        if (i == chunks - 1)
+            parts[i].finish_scan(context, parts[i].tokenized_code);
+    });
+
+    // Interning in chunk order gives the same ids as a serial run.
+    std::vector<std::vector<qint32>> remap(chunks * 4);
+    std::vector<qsizetype> first_token(chunks + 1, 0);
+    for (qsizetype i = 0; i < chunks; i++) {
+        for (int table = 0; table < 4; table++) {
+            const SymbolTable& local = parts[i].token_tables[table];
+            auto& ids = remap[i * 4 + table];
+
+            ids.resize(local.size());
+            for (qint32 id = 0; id < local.size(); id++)
+                ids[id] = token_tables[table].intern(local.text(id));
+        }
+        first_token[i + 1] = first_token[i] + parts[i].tokenized_code.size();
+        diagnostics.append(parts[i].diagnostics);
+    }
+
+    tokenized_code.resize(first_token[chunks]);
+
+    run([&](qsizetype i) {
+        const TokenStore& local = parts[i].tokenized_code;
+        const qsizetype first = first_token[i];
+
+        for (qsizetype j = 0; j < local.size(); j++) {
+            const TokenType type = local.type(j);
+            tokenized_code.set(first + j, type, local.offset(j), local.length(j),
+                               remap[i * 4 + table_index(type)][local.symbol(j)]);
+        }
+    });
+
+    tokenized_source = source.data();
+    return diagnostics.isEmpty();
+}
+
+namespace {
+
+bool is_token(const TokenStore& tokens, qsizetype i, QByteArrayView text) {
+    return tokens.length(i) == text.size() && tokens.text(i) == text;
+}
+
+/*!
+    Statement boundaries an edited region is widened to: the scanner is in
+    its start state right after them, and the parser has them on the stack
+    when the statement that follows is read.
+*/
+bool opens_region(const TokenStore& tokens, qsizetype i) {
+    return is_token(tokens, i, ";") || is_token(tokens, i, "begin");
+}
+
+bool closes_region(const TokenStore& tokens, qsizetype i) {
+    return is_token(tokens, i, ";") || is_token(tokens, i, "end");
+}
+
+} // namespace
+
+/*!
+    Tokenizes an edited version of the source, comparing it with the
+    current one to find what changed.
+*/
+TokenEdit Lexer::update(QSharedPointer<const SourceBuffer> buffer) {
+    if (source.isNull() || buffer.isNull())
+        return update(buffer, 0, 0, 0);
 
-            register_lexema(cand);
-            word = "";
+    const char* old_begin = source->data();
+    const char* old_end = old_begin + source->size();
+    const char* new_begin = buffer->data();
+    const char* new_end = new_begin + buffer->size();
 
+    const qsizetype prefix = std::mismatch(old_begin, old_end, new_begin, new_end).first - old_begin;
+    const qsizetype limit = qMin(source->size(), buffer->size()) - prefix;
+
+    qsizetype suffix = 0;
+    while (suffix < limit && old_end[-suffix - 1] == new_end[-suffix - 1])
+        suffix++;
+
+    return update(buffer, prefix, source->size() - prefix - suffix,
+                  buffer->size() - prefix - suffix);
+}
+
+/*!
+    Tokenizes buffer, which is the current source with removed bytes at
+    begin replaced by added ones. Only the statements the edit touches are
+    scanned again: the edit is widened to the nearest ";" or "begin" before
+    it and ";" or "end" after it, the tokens in between are replaced and the
+    ones after are moved. Falls back to analyze_parallel() when the tokens
+    are not those of the current source or the edit cannot be kept inside
+    the region (it opens a comment or joins a word to the closing "end").
+    Symbols of removed tokens stay in the tables.
+*/
+TokenEdit Lexer::update(QSharedPointer<const SourceBuffer> buffer,
+                        qsizetype begin, qsizetype removed, qsizetype added) {
+    TokenEdit edit;
+    edit.revision = revision;
+
+    auto full = [&]() {
+        edit.removed = tokenized_code.size();
+        source = buffer;
+        analyze_parallel();
+        edit.added = tokenized_code.size();
+        return edit;
+    };
+
+    if (buffer.isNull())
+        throw std::runtime_error("NoSourceLoadedError");
+    if (source.isNull() || tokenized_source != source.data() ||
+        buffer->size() != source->size() - removed + added)
+        return full();
+
+    const TokenStore& tokens = tokenized_code;
+    const qsizetype edit_end = begin + removed;
+
+    // First token starting at or after the edit.
+    qsizetype low = 0, high = tokens.size();
+    while (low < high) {
+        const qsizetype middle = low + (high - low) / 2;
+        if ((qsizetype)tokens.offset(middle) < begin)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+
+    qsizetype opening = low - 1;
+    for (; opening >= 0; opening--)
+        if ((qsizetype)(tokens.offset(opening) + tokens.length(opening)) < begin &&
+            opens_region(tokens, opening))
             break;
-        case 1:
-            appendingletters:
-            word += ch;
 
+    qsizetype closing = low;
+    for (; closing < tokens.size(); closing++)
+        if ((qsizetype)tokens.offset(closing) > edit_end && closes_region(tokens, closing))
             break;
-        case 2:
-            if (word.length() == 0)
-                goto onlydelimeter;
 
-            cand = Lexema(word);
-            if (cand.type() == TokenType::Error)
-                throw std::runtime_error("InvalidTokenValue");
+    if (opening < 0 || closing == tokens.size())
+        return full();
 
-            register_lexema(cand);
+    const qsizetype shift = added - removed;
+    const qsizetype region_begin = tokens.offset(opening) + tokens.length(opening);
+    const qsizetype region_end = tokens.offset(closing);
 
+    TokenStore region;
+    region.set_source(buffer->data());
+    const qsizetype reported = diagnostics.size();
 
-            onlydelimeter:
+    try {
+        ScanContext context;
+        context.offset = region_begin;
+        scan(buffer->data() + region_begin, buffer->data() + region_end + shift,
+             context, region);
 
-            // if (ch == '-' && word == "") {
-            //     if (in.read(1).at(0).isDigit()) {
-            //         in.seek(in.pos() - 1);
-            //         goto appendingletters;
-            //     }
-            //     else
-            //         in.seek(in.pos() - 1);
-            // }
+        if (context.state == S_COMMENT || context.state == S_COMMENT_STAR ||
+            (context.state == S_WORD && is_token(tokens, closing, "end"))) {
+            diagnostics.resize(reported);
+            return full();
+        }
+        finish_scan(context, region);
+    } catch (const std::runtime_error&) {
+        return full();
+    }
 
-            word = "";
+    QList<Diagnostic> updated;
+    for (qsizetype i = 0; i < reported; i++)
+        if ((qsizetype)diagnostics[i].offset < region_begin)
+            updated.push_back(diagnostics[i]);
+    for (qsizetype i = reported; i < diagnostics.size(); i++)
+        updated.push_back(diagnostics[i]);
+    for (qsizetype i = 0; i < reported; i++)
+        if ((qsizetype)diagnostics[i].offset >= region_end) {
+            updated.push_back(diagnostics[i]);
+            updated.back().offset = (quint32)(updated.back().offset + shift);
+        }
+    diagnostics.swap(updated);
 
+    edit.first = opening + 1;
+    edit.removed = closing - opening - 1;
+    edit.added = region.size();
+    edit.full = false;
 
-            if (s1 = ch, s2 = in.read(1).at(0), s1 == '/' && s2 == '*') {
-                while(s1 = in.read(1).at(0), s2 = in.read(1).at(0), s1 != '*' || s2 != '/')
-                    in.seek(in.pos() - 1);
+    tokenized_code.splice(edit.first, edit.removed, region, shift);
+    tokenized_code.set_source(buffer->data());
+    source = buffer;
+    tokenized_source = source.data();
+    revision++;
 
-                goto endcomment;
-            }
-            else
-                in.seek(in.pos()-1);
+    return edit;
+}
 
-            word += ch;
-            cand = Lexema(word);
-            if (cand.type() == TokenType::Error)
-                throw std::runtime_error("InvalidTokenValue");
+/*!
+    Returns a stream that lexes the source on demand, chunk_size bytes at
+    a time. Symbol tables are filled as tokens are pulled; tokenized_code
+    stays empty.
+*/
+TokenStream Lexer::stream(qsizetype chunk_size) {
+    reset();
+    return TokenStream(this, chunk_size);
+}
 
-            register_lexema(cand);
-            word = "";
+void Lexer::push_token(QByteArrayView text, qsizetype offset, TokenStore& out) {
+    Lexema cand(text);
+    if (Q_UNLIKELY(cand.type() == TokenType::Error)) {
+        report(offset, text.size(), "InvalidTokenValue");
+        return;
+    }
 
-            endcomment:
-            break;
-        case 3:
+    register_lexema(cand);
+    out.push_back(cand.type(), (quint32)offset, (quint32)text.size(), cand.symbol());
+}
 
-                throw std::runtime_error("UnknownCharacterError");
+/*!
+    Runs the DFA over one chunk, resuming from context.
+    A word still open at the end of the chunk is kept in context.carry.
+    Chunks must not split a UTF-8 sequence.
+*/
+void Lexer::scan(const char* begin, const char* end, ScanContext& context, TokenStore& out) {
+    const char* word_begin = begin;
+    quint8 state = context.state;
 
-            break;
+    auto offset_of = [&](const char* p) { return context.offset + (p - begin); };
+
+    auto push_word = [&](const char* to) {
+        if (context.carry.isEmpty())
+            push_token(QByteArrayView(word_begin, to - word_begin), offset_of(word_begin), out);
+        else {
+            context.carry.append(word_begin, to - word_begin);
+            push_token(context.carry, context.word_offset, out);
+            context.carry.clear();
+        }
+    };
+
+    for (const char* p = begin; p < end;) {
+        quint8 cls = char_classes[(quint8)*p];
+        qsizetype width = 1;
+
+        if (Q_UNLIKELY(cls == C_OTHER && (quint8)*p >= 0x80) &&
+            state != S_COMMENT && state != S_COMMENT_STAR) {
+            if ((width = scan::utf8_word_char(p, end)) != 0)
+                cls = C_ALNUM;
+            else
+                width = 1;
+        }
+
+        const Transition t = transitions[state][cls];
+
+        if (t.actions) {
+            if (t.actions & A_ERROR) {
+                report(offset_of(p), width, "UnknownCharacterError");
+                context.carry.clear();
+            }
+            if (t.actions & A_EMIT_WORD)
+                push_word(p);
+            if (t.actions & A_EMIT_SLASH)
+                push_token(QByteArrayView("/"), offset_of(p) - 1, out);
+            if (t.actions & A_EMIT_DELIM)
+                push_token(QByteArrayView(p, 1), offset_of(p), out);
+            if (t.actions & A_MARK)
+                word_begin = p;
+            if (t.actions & A_COMMENT)
+                context.comment_offset = offset_of(p) - 1;
+        }
+
+        state = t.next;
+        p += width;
+
+        // Runs that cannot change the state are skipped in bulk.
+        if (state == S_WORD)
+            p = scan::skip_word(p, end);
+        else if (state == S_START)
+            p = scan::skip_whitespace(p, end);
+        else if (state == S_COMMENT) {
+            const void* star = memchr(p, '*', end - p);
+            p = star ? static_cast<const char*>(star) : end;
         }
-        nextcycle:
     }
-    endcycle:
 
+    if (state == S_WORD) {
+        if (context.carry.isEmpty())
+            context.word_offset = offset_of(word_begin);
+        context.carry.append(word_begin, end - word_begin);
+    }
+    context.state = state;
+    context.offset = offset_of(end);
+}
 
-    if (code != 0) {
-        code->close();
-        delete code;
+/*!
+    Flushes whatever the DFA still holds at the end of the source.
+*/
+void Lexer::finish_scan(ScanContext& context, TokenStore& out) {
+    switch (context.state) {
+    case S_WORD:
+        push_token(context.carry, context.word_offset, out);
+        context.carry.clear();
+        break;
+    case S_SLASH:
+        push_token(QByteArrayView("/"), context.offset - 1, out);
+        break;
+    case S_COMMENT:
+    case S_COMMENT_STAR:
+        report(context.comment_offset, context.offset - context.comment_offset,
+               "UnterminatedCommentError");
+        break;
     }
 
-    return 1;
+    context.state = S_START;
 }
 
-Lexema::Lexema(QString value) : __value(value) {
-    if (lexemas_associations.contains(value))
-        __type = lexemas_associations[__value];
-    else if (Lexema::is_id(value))
-        __type = TokenType::Id;
-    else if (Lexema::is_const(value))
+namespace {
+
+/*!
+    Number of bytes at the end of [begin, end) that start a UTF-8 sequence
+    the range does not complete.
+*/
+qsizetype incomplete_utf8_tail(const char* begin, const char* end) {
+    for (qsizetype back = 1; back <= 3 && end - back >= begin; back++) {
+        const quint8 c = end[-back];
+
+        if ((c & 0xC0) == 0x80)
+            continue;
+        if (c < 0x80)
+            return 0;
+
+        qsizetype width = (c & 0xE0) == 0xC0 ? 2 : (c & 0xF0) == 0xE0 ? 3 : 4;
+        return width > back ? back : 0;
+    }
+    return 0;
+}
+
+} // namespace
+
+TokenStream::TokenStream(Lexer* lexer, qsizetype chunk_size)
+    : __lexer(lexer), __chunk_size(qMax(chunk_size, (qsizetype)4)) {
+
+    if (lexer->source->is_file()) {
+        __file = std::make_unique<QFile>(lexer->source->filename());
+        if (!__file->open(QIODeviceBase::ReadOnly))
+            throw std::runtime_error(QString("Cannot open file: %1")
+                                         .arg(lexer->source->filename()).toStdString());
+        __chunk.resize(__chunk_size + 4);
+    }
+}
+
+/*!
+    Scans the next chunk into __pending.
+*/
+void TokenStream::read_chunk() {
+    __pending.clear();
+    __index = 0;
+
+    const char* begin;
+    const char* end;
+    bool last;
+
+    if (__file) {
+        char* data = __chunk.data();
+        qint64 read = __file->read(data + __kept, __chunk_size);
+        if (read < 0)
+            throw std::runtime_error(__file->errorString().toStdString());
+
+        begin = data;
+        end = data + __kept + read;
+        last = read == 0;
+    }
+    else {
+        const SourceBuffer& source = *__lexer->source;
+        begin = source.data() + __context.offset;
+        end = source.data() + qMin(source.size(), __context.offset + __chunk_size);
+        last = end == source.data() + source.size();
+    }
+
+    qsizetype tail = last ? 0 : incomplete_utf8_tail(begin, end);
+    __lexer->scan(begin, end - tail, __context, __pending);
+
+    if (__file) {
+        memmove(__chunk.data(), end - tail, tail);
+        __kept = tail;
+    }
+
+    if (last) {
+        __lexer->finish_scan(__context, __pending);
+        __finished = true;
+    }
+}
+
+/*!
+    Stores the next token in lex.
+    Returns false once the source is exhausted.
+*/
+bool TokenStream::next(Lexema& lex) {
+    if (__tokens) {
+        if (__index == __tokens->size())
+            return false;
+
+        lex = __tokens->at(__index++);
+        return true;
+    }
+
+    while (__index == __pending.size()) {
+        if (__finished)
+            return false;
+        read_chunk();
+    }
+
+    const TokenType type = __pending.type(__index);
+    const qint32 symbol = __pending.symbol(__index);
+    lex = Lexema(__lexer->get_table(type).text(symbol), type)
+              .setSymbol(symbol)
+              .setOffset(__pending.offset(__index));
+    __index++;
+    return true;
+}
+
+/*!
+    Classifies the token without regexes or allocations: a perfect hash
+    lookup for keywords and delimeters, then character class checks.
+*/
+Lexema::Lexema(QByteArrayView text) : __text(text) {
+    std::string_view value(text.data(), text.size());
+
+    if (qint8 index = association_index(value); index >= 0) {
+        __type = lexemas_associations[index].type;
+        __grammar = (quint8)index;
+    }
+    // Numbers of two or more digits also match the id pattern.
+    else if (Lexema::is_const(value)) {
         __type = TokenType::Const;
+        __grammar = grammar::A;
+    }
+    else if (Lexema::is_id(value)) {
+        __type = TokenType::Id;
+        __grammar = grammar::A;
+    }
     else
         __type = TokenType::Error;
 }
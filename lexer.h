@@ -1,13 +1,21 @@
 #ifndef LEXER_H
 #define LEXER_H
 
-#include <QMap>
 #include <QList>
 #include <QString>
+#include <QByteArrayView>
+#include <QSharedPointer>
 #include <QVariant>
-#include <QFile>
-#include <QTextStream>
-#include <QRegularExpression>
+
+#include <algorithm>
+#include <array>
+#include <iterator>
+#include <memory>
+#include <string_view>
+
+#include "diagnostics.h"
+#include "source.h"
+#include "symbols.h"
 
 
 enum class TokenType {
@@ -19,15 +27,24 @@ enum class TokenType {
     Error = 0x0,
 };
 
-inline QMap<TokenType, QString> token_type_to_qstring = {
-    {TokenType::Word, QString("Word")},
-    {TokenType::Delimeter, QString("Delimeter")},
-    {TokenType::Id, QString("Id")},
-    {TokenType::Const, QString("Const")},
-    {TokenType::Error, QString("Error")}
+constexpr const char* token_type_name(TokenType type) {
+    switch (type) {
+    case TokenType::Word: return "Word";
+    case TokenType::Delimeter: return "Delimeter";
+    case TokenType::Id: return "Id";
+    case TokenType::Const: return "Const";
+    case TokenType::Nonterminal: return "Nonterminal";
+    case TokenType::Error: return "Error";
+    }
+    return "Error";
+}
+
+struct Association {
+    std::string_view text;
+    TokenType type;
 };
 
-inline QMap<QString, TokenType> lexemas_associations = {
+inline constexpr Association lexemas_associations[] = {
     {"program", TokenType::Word},
     {"var", TokenType::Word},
     {"begin", TokenType::Word},
@@ -54,73 +71,267 @@ inline QMap<QString, TokenType> lexemas_associations = {
     {"=", TokenType::Delimeter}
 };
 
-inline QString id_pattern = "^\\w\\d*\\w$";
-inline QString const_pattern = "^(\\d+|-\\d+)$"; // "^\\d+$";
-inline QList<QString> spec_op_words = {
+/*!
+    Perfect hash over lexemas_associations, generated at compile time:
+    the first seed for which every keyword and delimeter lands in its own
+    slot of association_table is chosen by the compiler.
+*/
+namespace association_hash {
+
+constexpr std::size_t table_size = 64;
+constexpr std::size_t count = std::size(lexemas_associations);
+
+constexpr quint32 hash(std::string_view text, quint32 seed) {
+    quint32 h = seed;
+    for (char c : text)
+        h = (h ^ (quint8)c) * 16777619u;
+    return h ^ (h >> 15);
+}
+
+constexpr bool is_perfect(quint32 seed) {
+    bool used[table_size] = {};
+    for (const auto& a : lexemas_associations) {
+        std::size_t slot = hash(a.text, seed) % table_size;
+        if (used[slot])
+            return false;
+        used[slot] = true;
+    }
+    return true;
+}
+
+constexpr quint32 find_seed() {
+    for (quint32 seed = 2166136261u; seed < 2166136261u + 10000; seed++)
+        if (is_perfect(seed))
+            return seed;
+    return 0;
+}
+
+constexpr quint32 seed = find_seed();
+static_assert(seed != 0, "no perfect hash seed for lexemas_associations");
+
+constexpr std::array<qint8, table_size> make_table() {
+    std::array<qint8, table_size> table {};
+    for (auto& slot : table)
+        slot = -1;
+    for (std::size_t i = 0; i < count; i++)
+        table[hash(lexemas_associations[i].text, seed) % table_size] = (qint8)i;
+    return table;
+}
+
+constexpr std::array<qint8, table_size> table = make_table();
+
+} // namespace association_hash
+
+/*!
+    Returns the index of a keyword or delimeter in lexemas_associations,
+    -1 otherwise.
+*/
+constexpr qint8 association_index(std::string_view text) {
+    if (text.empty() || text.size() > 7)
+        return -1;
+
+    qint8 index = association_hash::table[
+        association_hash::hash(text, association_hash::seed) % association_hash::table_size];
+
+    if (index < 0 || lexemas_associations[index].text != text)
+        return -1;
+    return index;
+}
+
+/*!
+    Returns the type of a keyword or delimeter, TokenType::Error otherwise.
+*/
+constexpr TokenType association_type(std::string_view text) {
+    qint8 index = association_index(text);
+    return index < 0 ? TokenType::Error : lexemas_associations[index].type;
+}
+
+static_assert(association_type("integer") == TokenType::Word);
+static_assert(association_type("=") == TokenType::Delimeter);
+static_assert(association_type("intege") == TokenType::Error);
+
+/*!
+    Grammar symbols as small integers, used to index the parser tables.
+    Keywords and delimeters keep their index in lexemas_associations and
+    are followed by "a" (any id or const), the stack bottom "^", the end of
+    input "$" and the nonterminal E.
+*/
+namespace grammar {
+
+constexpr quint8 A = (quint8)std::size(lexemas_associations);
+constexpr quint8 BOTTOM = A + 1;
+constexpr quint8 END = A + 2;
+constexpr quint8 E = A + 3;
+
+constexpr quint8 TERMINALS = E;
+constexpr quint8 COUNT = E + 1;
+constexpr quint8 NONE = 0xFF;
+
+/*!
+    Returns the grammar symbol named by text as it is written in the
+    parser tables, NONE if there is no such symbol.
+*/
+constexpr quint8 symbol(std::string_view text) {
+    if (text == "a")
+        return A;
+    if (text == "^")
+        return BOTTOM;
+    if (text == "$")
+        return END;
+    if (text == "E")
+        return E;
+
+    qint8 index = association_index(text);
+    return index < 0 ? NONE : (quint8)index;
+}
+
+/*!
+    Returns the grammar symbol of a token.
+*/
+constexpr quint8 symbol(TokenType type, std::string_view text) {
+    switch (type) {
+    case TokenType::Id:
+    case TokenType::Const:
+        return A;
+    case TokenType::Nonterminal:
+        return E;
+    case TokenType::Word:
+    case TokenType::Delimeter:
+        return symbol(text);
+    default:
+        return NONE;
+    }
+}
+
+/*!
+    Returns the name of a grammar symbol as it is written in the parser
+    tables.
+*/
+constexpr std::string_view name(quint8 symbol) {
+    if (symbol < A)
+        return lexemas_associations[symbol].text;
+
+    switch (symbol) {
+    case A: return "a";
+    case BOTTOM: return "^";
+    case END: return "$";
+    case E: return "E";
+    default: return "???";
+    }
+}
+
+} // namespace grammar
+
+static_assert(grammar::symbol("program") == 0);
+static_assert(grammar::symbol(TokenType::Const, "12") == grammar::A);
+static_assert(grammar::symbol(TokenType::Delimeter, "$") == grammar::END);
+
+inline constexpr std::string_view spec_op_words[] = {
     "input",
     "output"
 };
 
+/*!
+    A token is a view into the SourceBuffer it was read from (or into a
+    string literal for grammar symbols); its text is only turned into a
+    QString when value() is asked for.
+*/
 class Lexema {
 
-    QString __value;
-    TokenType __type;
-    QString __name = "";
+    QByteArrayView __text;
+    TokenType __type = TokenType::Error;
+    qint32 __symbol = -1;
+    quint32 __offset = 0;
+    quint8 __grammar = grammar::NONE;
+
+    void update_grammar() {
+        __grammar = grammar::symbol(__type, std::string_view(__text.data(), __text.size()));
+    }
 
 public:
     Lexema() {}
-    Lexema(QString);
-    Lexema(QString v, TokenType t) : __value(v), __type(t) {};
+    Lexema(QByteArrayView);
+    Lexema(QByteArrayView v, TokenType t) : __text(v), __type(t) { update_grammar(); };
 
-    QString value() const { return __value; }
+    QByteArrayView text() const { return __text; }
+    QString value() const { return QString::fromUtf8(__text); }
     TokenType type() const { return __type; }
-    Lexema& setValue(QString value) { __value = value; return *this; }
-    Lexema& setType(TokenType type) { __type = type; return *this; }
-    QString const_name() const { return __name; }
-    Lexema& set_name(QString name) { __name = name; return *this; }
+    Lexema& setText(QByteArrayView text) { __text = text; update_grammar(); return *this; }
+    Lexema& setType(TokenType type) { __type = type; update_grammar(); return *this; }
+    /*!
+        Grammar symbol of the token, see namespace grammar.
+    */
+    quint8 grammar() const { return __grammar; }
+    qint32 symbol() const { return __symbol; }
+    Lexema& setSymbol(qint32 symbol) { __symbol = symbol; return *this; }
+    quint32 offset() const { return __offset; }
+    Lexema& setOffset(quint32 offset) { __offset = offset; return *this; }
 
-    QString toQString() { return QString("(\"%1\", %2)\n")
-                              .arg(__value, token_type_to_qstring[__type]) ; }
+    QString toQString() const { return QString("(\"%1\", %2)\n")
+                                    .arg(value(), QLatin1String(token_type_name(__type))); }
 
-    static bool is_id(QString& candidate) {
-        QRegularExpression re = QRegularExpression(id_pattern);
+    static constexpr bool is_word_char(char c) {
+        return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+               (c >= '0' && c <= '9') || c == '_';
+    }
+    static constexpr bool is_digit(char c) { return c >= '0' && c <= '9'; }
 
-        QRegularExpressionMatchIterator matches = re.globalMatch(candidate);
+    /*!
+        Same as matching ^\w\d*\w$ with ASCII \w: a word character,
+        any number of digits, a word character.
+    */
+    static constexpr bool is_id(std::string_view candidate) {
+        if (candidate.size() < 2 ||
+            !is_word_char(candidate.front()) || !is_word_char(candidate.back()))
+            return 0;
 
-        if (matches.hasNext() && matches.next().hasMatch() && !matches.hasNext())
-            return 1;
-        return 0;
+        for (std::size_t i = 1; i + 1 < candidate.size(); i++)
+            if (!is_digit(candidate[i]))
+                return 0;
+        return 1;
     }
-    static bool is_const(QString& candidate) {
-        QRegularExpression re = QRegularExpression(const_pattern);
+    /*!
+        Same as matching ^(\d+|-\d+)$.
+    */
+    static constexpr bool is_const(std::string_view candidate) {
+        if (!candidate.empty() && candidate.front() == '-')
+            candidate.remove_prefix(1);
 
-        QRegularExpressionMatch match = re.match(candidate);
+        if (candidate.empty())
+            return 0;
 
-        if (match.hasMatch())
-            return 1;
-        return 0;
+        for (char c : candidate)
+            if (!is_digit(c))
+                return 0;
+        return 1;
     }
     static bool is_op(Lexema& lex) {
         if (lex.__type != TokenType::Word)
             return false;
 
-        if (!spec_op_words.contains(lex.__value))
+        const std::string_view text(lex.__text.data(), lex.__text.size());
+        if (std::find(std::begin(spec_op_words), std::end(spec_op_words), text) ==
+            std::end(spec_op_words))
             return false;
 
         return true;
     }
     static bool is_arithm(Lexema& lex) {
-        if (lex.__value == '+' || lex.__value == '-' ||
-            lex.__value == '/' || lex.__value == '*')
+        if (lex.__text == "+" || lex.__text == "-" ||
+            lex.__text == "/" || lex.__text == "*")
             return true;
         return false;
     }
 
+    /*!
+        Grammar symbol equality: any Id matches any Id and any Const any
+        Const. Use symbol() to tell two names apart.
+    */
     bool operator==(const Lexema& lex) const {
         if ((__type == TokenType::Const && lex.__type == TokenType::Const) ||
             (__type == TokenType::Id && lex.__type == TokenType::Id))
             return true;
-        if (__type == lex.__type && __value == lex.__value)
+        if (__type == lex.__type && __text == lex.__text)
             return true;
         return false;
     }
@@ -152,67 +363,245 @@ public:
     static Lexema E() { return Lexema("E", TokenType::Nonterminal); }
 };
 
+/*!
+    Compact token storage: parallel arrays of 1-byte types, 32-bit source
+    offsets and lengths and 32-bit symbol ids, 13 bytes per token.
+    A Lexema is only put together when a caller asks for one with at();
+    its text is a view into the source the offsets refer to.
+*/
+class TokenStore {
+    QList<quint8> __types;
+    QList<quint32> __offsets;
+    QList<quint32> __lengths;
+    QList<qint32> __symbols;
+    const char* __source = nullptr;
+
+public:
+    void set_source(const char* source) { __source = source; }
+
+    void clear() {
+        __types.clear();
+        __offsets.clear();
+        __lengths.clear();
+        __symbols.clear();
+    }
+    void reserve(qsizetype size) {
+        __types.reserve(size);
+        __offsets.reserve(size);
+        __lengths.reserve(size);
+        __symbols.reserve(size);
+    }
+    void resize(qsizetype size) {
+        __types.resize(size);
+        __offsets.resize(size);
+        __lengths.resize(size);
+        __symbols.resize(size);
+    }
+
+    void push_back(TokenType type, quint32 offset, quint32 length, qint32 symbol) {
+        __types.push_back((quint8)type);
+        __offsets.push_back(offset);
+        __lengths.push_back(length);
+        __symbols.push_back(symbol);
+    }
+    void set(qsizetype i, TokenType type, quint32 offset, quint32 length, qint32 symbol) {
+        __types[i] = (quint8)type;
+        __offsets[i] = offset;
+        __lengths[i] = length;
+        __symbols[i] = symbol;
+    }
+
+    qsizetype size() const { return __types.size(); }
+    bool isEmpty() const { return __types.isEmpty(); }
+
+    TokenType type(qsizetype i) const { return (TokenType)__types[i]; }
+    quint32 offset(qsizetype i) const { return __offsets[i]; }
+    quint32 length(qsizetype i) const { return __lengths[i]; }
+    qint32 symbol(qsizetype i) const { return __symbols[i]; }
+
+    QByteArrayView text(qsizetype i) const {
+        return QByteArrayView(__source + __offsets[i], __lengths[i]);
+    }
+    QString value(qsizetype i) const { return QString::fromUtf8(text(i)); }
+
+    Lexema at(qsizetype i) const {
+        return Lexema(text(i), type(i)).setSymbol(symbol(i)).setOffset(offset(i));
+    }
+    Lexema operator[](qsizetype i) const { return at(i); }
+
+    /*!
+        Replaces count tokens at first with the tokens of with and moves
+        the offsets of the tokens after them by shift bytes.
+    */
+    void splice(qsizetype first, qsizetype count, const TokenStore& with, qint64 shift) {
+        auto replace = [&](auto& list, const auto& items) {
+            const qsizetype added = items.size();
+            if (added > count) {
+                const qsizetype old_size = list.size();
+                list.resize(old_size + added - count);
+                std::move_backward(list.begin() + first + count,
+                                   list.begin() + old_size, list.end());
+            }
+            else if (added < count) {
+                std::move(list.begin() + first + count, list.end(),
+                          list.begin() + first + added);
+                list.resize(list.size() - count + added);
+            }
+            std::copy(items.begin(), items.end(), list.begin() + first);
+        };
+
+        replace(__types, with.__types);
+        replace(__offsets, with.__offsets);
+        replace(__lengths, with.__lengths);
+        replace(__symbols, with.__symbols);
+
+        for (qsizetype i = first + with.size(); i < size(); i++)
+            __offsets[i] = (quint32)(__offsets[i] + shift);
+    }
+};
+
+/*!
+    What Lexer::update() did to the token list: removed tokens starting at
+    first were replaced by added new ones. revision is the token list the
+    edit applies to. full means everything was tokenized again.
+*/
+struct TokenEdit {
+    qsizetype first = 0;
+    qsizetype removed = 0;
+    qsizetype added = 0;
+    quint64 revision = 0;
+    bool full = true;
+};
+
+
+/*!
+    Where the scanner stopped in the source: the DFA state, the source
+    offset of the next chunk and the head of a word cut off by the end of
+    the previous chunk.
+*/
+struct ScanContext {
+    quint8 state = 0;
+    qsizetype offset = 0;
+    qsizetype word_offset = 0;
+    qsizetype comment_offset = 0;
+    QByteArray carry;
+};
+
+class TokenStream;
 
 class Lexer {
+    friend class TokenStream;
+
 public:
     QList<QString> token_types = {"words", "ids", "consts", "delimeters"};
 private:
-    QMap<QString, QList<Lexema>> token_tables;
-    QList<Lexema> tokenized_code;
+    SymbolTable token_tables[4];
+    TokenStore tokenized_code;
+    QList<Diagnostic> diagnostics;
+    bool collect_diagnostics = false;
 
-    bool is_reading_from_file = false;
-    QString source_code;
+    QSharedPointer<const SourceBuffer> source;
+    const SourceBuffer* tokenized_source = nullptr;
+    quint64 revision = 0;
+
+    /*!
+        Index of the table holding tokens of the type, in token_types order.
+    */
+    static int table_index(TokenType type) {
+        switch (type) {
+        case TokenType::Word: return 0;
+        case TokenType::Id: return 1;
+        case TokenType::Const: return 2;
+        case TokenType::Delimeter: return 3;
+        default: return -1;
+        }
+    }
 
     void register_lexema(Lexema& lex) {
-        switch (lex.type()) {
-        case TokenType::Word:
-            if (!token_tables["words"].contains(lex))
-                token_tables["words"].push_back(lex);
-            break;
-        case TokenType::Const:
-            if (!token_tables["consts"].contains(lex))
-                token_tables["consts"].push_back(lex);
-            break;
-        case TokenType::Id:
-            if (!token_tables["ids"].contains(lex))
-                token_tables["ids"].push_back(lex);
-            break;
-        case TokenType::Delimeter:
-            if (!token_tables["delimeters"].contains(lex))
-                token_tables["delimeters"].push_back(lex);
-            break;
-        default:
+        int table = table_index(lex.type());
+        if (table < 0)
             throw std::runtime_error("InvalidTokenTypeError");
-        }
 
-        tokenized_code.push_back(lex);
+        lex.setSymbol(token_tables[table].intern(lex.text()));
     }
 
+    void reset();
+    void report(qsizetype offset, qsizetype length, const QString& message);
+    void push_token(QByteArrayView text, qsizetype offset, TokenStore& out);
+    void scan(const char* begin, const char* end, ScanContext& context, TokenStore& out);
+    void finish_scan(ScanContext& context, TokenStore& out);
+
 public:
-    Lexer() {
-        foreach (auto i, token_types)
-            token_tables[i] = {};
-    };
-
-    bool is_read_from_file() { return is_reading_from_file; }
-    QString filename() {
-        if (is_reading_from_file)
-            return source_code.append(".asm");
+    Lexer() {};
+
+    bool is_read_from_file() const { return source && source->is_file(); }
+    QString filename() const {
+        if (is_read_from_file())
+            return source->filename() + ".asm";
         else
             return QString::fromStdString("a.asm");
     }
+    QSharedPointer<const SourceBuffer> get_source() const { return source; }
+
+    const TokenStore& get_tokenized_code() const { return tokenized_code; }
+    quint64 get_revision() const { return revision; }
+    const QList<Diagnostic>& get_diagnostics() const { return diagnostics; }
+    SymbolTable& get_words() { return token_tables[0]; }
+    SymbolTable& get_ids() { return token_tables[1]; }
+    SymbolTable& get_consts() { return token_tables[2]; }
+    SymbolTable& get_delimeters() { return token_tables[3]; }
+    SymbolTable& get_table(qsizetype index) { return token_tables[index]; }
+    SymbolTable& get_table(TokenType type) { return token_tables[table_index(type)]; }
+    const SymbolTable& get_words() const { return token_tables[0]; }
+    const SymbolTable& get_ids() const { return token_tables[1]; }
+    const SymbolTable& get_consts() const { return token_tables[2]; }
+    const SymbolTable& get_delimeters() const { return token_tables[3]; }
+    const SymbolTable& get_table(qsizetype index) const { return token_tables[index]; }
 
-    QList<Lexema>& get_tokenized_code() { return tokenized_code; }
-    QList<Lexema>& get_words() { return token_tables["words"]; }
-    QList<Lexema>& get_ids() { return token_tables["ids"]; }
-    QList<Lexema>& get_consts() { return token_tables["consts"]; }
-    QList<Lexema>& get_delimeters() { return token_tables["delimeters"]; }
-    QMap<QString, QList<Lexema>>& get_tables() {return token_tables;}
+    void set_collect_diagnostics(bool collect) { collect_diagnostics = collect; }
+    bool is_collecting_diagnostics() const { return collect_diagnostics; }
 
     bool analyze();
+    bool analyze_parallel(int threads = 0);
+    TokenEdit update(QSharedPointer<const SourceBuffer> buffer);
+    TokenEdit update(QSharedPointer<const SourceBuffer> buffer,
+                     qsizetype begin, qsizetype removed, qsizetype added);
+    TokenStream stream(qsizetype chunk_size = 64 * 1024);
 
     bool loadFile(QString);
     bool loadText(QString&);
+    bool loadSource(QSharedPointer<const SourceBuffer>);
+};
+
+/*!
+    Pull-based token source for the parser.
+    Either walks the tokens Lexer::analyze() already produced, or lexes the
+    source on demand in chunks of a fixed size. In the second mode only one
+    chunk of text and the tokens scanned from it are alive at a time;
+    token texts are taken from the lexer's symbol tables. Files are read with
+    QFile::read rather than mapped, so the untouched rest of the file is
+    never resident.
+*/
+class TokenStream {
+    const TokenStore* __tokens = nullptr;
+    qsizetype __index = 0;
+
+    Lexer* __lexer = nullptr;
+    std::unique_ptr<QFile> __file;
+    qsizetype __chunk_size = 0;
+    QByteArray __chunk;
+    qsizetype __kept = 0;
+    ScanContext __context;
+    TokenStore __pending;
+    bool __finished = false;
+
+    void read_chunk();
+
+public:
+    explicit TokenStream(const TokenStore& tokens) : __tokens(&tokens) {}
+    TokenStream(Lexer* lexer, qsizetype chunk_size);
+
+    bool next(Lexema& lex);
 };
 
 #endif // LEXER_H
@@ -1,9 +1,49 @@
 #include "mainwindow.h"
+#include "batch.h"
 
 #include <QApplication>
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QTextStream>
+
+#include <cstring>
+
+/*!
+    dslgui --batch <directory> [-j threads] [--no-asm] [--dump-ir] [--verify-ir]
+    compiles every .dsl file under the directory without a window and
+    prints the report; the exit code is 1 if any of them failed.
+*/
+static int run_batch(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    QCommandLineParser options;
+    options.addHelpOption();
+    options.addOption({"batch", "Compile every .dsl file under <directory>.", "directory"});
+    options.addOption({{"j", "threads"}, "Worker threads, every core by default.", "threads", "0"});
+    options.addOption({"no-asm", "Stop after semantic analysis."});
+    options.addOption({"dump-ir", "Write the optimized IR of every file to <file>.ir."});
+    options.addOption({"verify-ir", "Verify the IR after every pass that changes it."});
+    options.process(app);
+
+    CompileOptions compile;
+    compile.generate_asm = !options.isSet("no-asm");
+    compile.dump_ir = options.isSet("dump-ir");
+    compile.verify_ir = options.isSet("verify-ir");
+
+    BatchCompiler batch(options.value("threads").toInt(), compile);
+    BatchReport report = batch.run(options.value("batch"));
+
+    QTextStream(stdout) << report.toQString();
+    return report.failed() ? 1 : 0;
+}
 
 int main(int argc, char *argv[])
 {
+    for (int i = 1; i < argc; i++)
+        if (std::strcmp(argv[i], "--batch") == 0)
+            return run_batch(argc, argv);
+
     QApplication a(argc, argv);
     MainWindow w;
     w.show();
@@ -13,7 +13,9 @@ MainWindow::MainWindow(QWidget *parent)
     ui->setupUi(this);
 
     lexer = Lexer();
+    lexer.set_collect_diagnostics(true);
     parser = Parser(&lexer);
+    parser.set_collect_diagnostics(true);
 
 #ifdef DEBUG_FILE
     lexer.loadFile("/home/mainekun/dslcode/factorial.dsl");
@@ -34,14 +36,12 @@ void MainWindow::on_openFileButton_released()
                                  "$HOME",
                                  tr("DSL Files (*.dsl)"));
 
-    lexer.loadFile(code_filename);
+    auto source = SourceBuffer::fromFile(code_filename);
+    if (!lexer.loadSource(source))
+        return;
+    pending_edit.reset();
 
-    QFile file(code_filename);
-    file.open(QIODeviceBase::ReadOnly);
-
-    ui->codeEdit->setText(file.readAll());
-
-    file.close();
+    ui->codeEdit->setText(source->toQString());
 
     ui->statusbar->showMessage("file loaded", 3000);
 }
@@ -51,7 +51,8 @@ void MainWindow::on_useTextButton_released()
 {
     QString code = ui->codeEdit->toPlainText();
 
-    lexer.loadText(code);
+    // Only the statements changed since the last run are tokenized again.
+    pending_edit = lexer.update(SourceBuffer::fromText(code));
 
     ui->statusbar->showMessage("Text loaded", 3000);
 }
@@ -59,60 +60,93 @@ void MainWindow::on_useTextButton_released()
 
 void MainWindow::on_runButton_released()
 {
+    std::optional<TokenEdit> edit;
+    edit.swap(pending_edit);
+
     try {
-        if (lexer.analyze())
-            ui->infoEdit->setText(tr("Tokenization succeeded!\nLexemas count: %1\n")
-                .arg(lexer.get_tokenized_code().length()));
+        if (!(edit ? lexer.get_diagnostics().isEmpty() : lexer.analyze_parallel())) {
+            ui->infoEdit->setText(tr("Tokenization failed, %1 errors:")
+                .arg(lexer.get_diagnostics().size()));
+            for (const Diagnostic& d : lexer.get_diagnostics())
+                ui->infoEdit->append(tr("%1: %2")
+                    .arg(lexer.get_source()->location(d.offset), d.message));
+
+            ui->statusbar->showMessage("Tokenization failed", 10000);
+            return;
+        }
+
+        ui->infoEdit->setText(tr("Tokenization succeeded!\nLexemas count: %1\n")
+            .arg(lexer.get_tokenized_code().size()));
 
         ui->statusbar->showMessage(
             QString("Succeeded. Lexemas count : %1")
-                .arg(lexer.get_tokenized_code().length()),
+                .arg(lexer.get_tokenized_code().size()),
             10000
             );
 
         ui->tokenizedEdit->setText([&]()->QString{
             QString res = "";
 
-            foreach(auto i, lexer.get_tokenized_code())
-                res += i.toQString();
+            const TokenStore& tokens = lexer.get_tokenized_code();
+            for (qsizetype i = 0; i < tokens.size(); i++)
+                res += tokens.at(i).toQString();
 
             return res;
         }());
 
-        auto map = lexer.get_tables();
         auto tables = lexer.token_types;
 
         auto max = [](int a, int b) { return a > b ? a : b; };
 
         ui->tokenTable->setColumnCount(4);
         ui->tokenTable->setRowCount(max(
-            max(map["words"].length(), map["ids"].length()),
-            max(map["delimeters"].length(), map["consts"].length())));
+            max(lexer.get_words().size(), lexer.get_ids().size()),
+            max(lexer.get_delimeters().size(), lexer.get_consts().size())));
 
         ui->tokenTable->setHorizontalHeaderLabels(tables);
 
         for (int table = 0; table < tables.size(); table++) {
-            for (int i = 0; i < map[tables[table]].size(); i++)
+            const SymbolTable& symbols = lexer.get_table(table);
+            for (int i = 0; i < symbols.size(); i++)
                 ui->tokenTable->setItem(i,table,
-                    new QTableWidgetItem(map[tables[table]][i].value()));
+                    new QTableWidgetItem(symbols.value(i)));
         }
 
-        if (parser.analyze())
-            ui->infoEdit->append(tr("Parsing succeeded!\nConvolution sequance:"));
+        if (!(edit ? parser.update(*edit) : parser.analyze())) {
+            ui->infoEdit->append(tr("Parsing failed, %1 errors:")
+                .arg(parser.diagnostics().size()));
+            for (const Diagnostic& d : parser.diagnostics())
+                ui->infoEdit->append(tr("%1: %2")
+                    .arg(lexer.get_source()->location(d.offset), d.message));
+
+            ui->statusbar->showMessage("Parsing failed", 10000);
+            return;
+        }
+
+        ui->infoEdit->append(tr("Parsing succeeded!\nAST: %1 nodes, %2 bytes per token")
+            .arg(parser.ast().size())
+            .arg(parser.ast().bytes_per_token(), 0, 'f', 1));
+        ui->infoEdit->append(tr("Syntax tree:"));
 
         ui->infoEdit->append([&]()->QString{
+            const Ast& ast = parser.ast();
+            const TokenStore& tokens = lexer.get_tokenized_code();
             QString r;
-            foreach (auto& i, parser.conv_sequance())
-                r += tr("%1: %2\n").arg(i.first).arg([&](){
-                    QString buff;
-                    foreach (auto lex, i.second) {
-                        buff += (lex.value() == "a"
-                                     ? lex.const_name() :
-                                     lex.value())  + " ";
-                    }
-
-                    return buff;
-                }());
+            // Where the subtrees around the current node end
+            QList<qsizetype> ends;
+            for (qsizetype i = 0; i < ast.size(); i++) {
+                while (!ends.isEmpty() && ends.last() <= i)
+                    ends.removeLast();
+
+                const AstNode& node = ast[i];
+                r += QString(2 * ends.size(), ' ');
+                if (node.rule < 0)
+                    r += tokens.value(node.first) + "\n";
+                else
+                    r += QString::fromUtf8(rules[node.rule].name.data(),
+                                           rules[node.rule].name.size()) + "\n";
+                ends.append(ast.next_sibling(i));
+            }
 
             return r;
         }());
@@ -123,28 +157,21 @@ void MainWindow::on_runButton_released()
         else
             ui->infoEdit->append("Semantic analysis succceeded");
 
-        AsmGenerator asmgen(&lexer);
+        ir::Function function;
+        ir::Builder(&lexer, &parser.ast()).build(function);
+        ir::PassManager::standard().run(function);
+
+        AsmGenerator asmgen(&lexer, &function, &parser.variables());
         asmgen.generate(lexer.filename());
+        ui->infoEdit->append(QString("Registers: %1 values, %2 left in memory")
+            .arg(asmgen.allocation().intervals())
+            .arg(asmgen.allocation().spilled()));
+        ui->infoEdit->append(asmgen.peephole().report());
 
     }
     catch(std::exception& e) {
         ui->statusbar->showMessage(e.what(), 10000);
-        ui->infoEdit->setText([&]()->QString{
-            QString r;
-            foreach (auto& i, parser.conv_sequance())
-                r += tr("%1: %2\n").arg(i.first).arg([&](){
-                    QString buff;
-                    foreach (auto lex, i.second) {
-                        buff += (lex.value() == "a"
-                                     ? lex.const_name() :
-                                     lex.value())  + " ";
-                    }
-
-                    return buff;
-                }());
-
-            return r += tr("\n") + tr(e.what());
-        }());
+        ui->infoEdit->setText(tr(e.what()));
     }
 
 }
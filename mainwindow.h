@@ -6,9 +6,13 @@
 #include <QString>
 #include <QFile>
 
+#include <optional>
+
 #include "lexer.h"
 #include "parser.h"
 #include "sema.h"
+#include "irbuilder.h"
+#include "passes.h"
 #include "translation.h"
 
 QT_BEGIN_NAMESPACE
@@ -23,6 +27,7 @@ class MainWindow : public QMainWindow
 
     Lexer lexer;
     Parser parser;
+    std::optional<TokenEdit> pending_edit;
 
 public:
     MainWindow(QWidget *parent = nullptr);
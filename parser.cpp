@@ -1,68 +1,289 @@
 #include "parser.h"
 #include <string>
 
+/*!
+    Parses the tokens produced by Lexer::analyze(), reading the token store
+    through an index cursor.
+*/
 [[nodiscard]] bool Parser::analyze() {
-    qsizetype the_largest_rule = rules[0].len();
-    foreach(auto& rule, rules) {
-        if (the_largest_rule < rule.len())
-            the_largest_rule = rule.len();
-    }
+    const TokenStore& tokens = __lexer->get_tokenized_code();
+    qsizetype index = 0;
+
+    return parse([&](Lexema& lex) {
+        if (index == tokens.size())
+            return false;
+        lex = tokens.at(index++);
+        return true;
+    }, tokens.size());
+}
 
-    QList<Lexema> observe_list;
+/*!
+    Parses tokens pulled from the stream one at a time, so the input never
+    has to be materialised.
+*/
+[[nodiscard]] bool Parser::analyze(TokenStream& tokens) {
+    return parse([&](Lexema& lex) { return tokens.next(lex); }, 0);
+}
 
-    foreach(auto i, __lexer->get_tokenized_code())
-        __line.push_back(i);
+/*!
+    The precedence parser itself. next(lex) yields the following token and
+    returns false at the end of input. The stack holds one entry per shifted
+    or reduced symbol, so size_hint + 2 entries are always enough and
+    parsing a known number of tokens does not allocate.
+*/
+namespace {
 
-    __line.push_back(Lexema("$", TokenType::Delimeter));
+constexpr quint8 semicolon_symbol = grammar::symbol(";");
+constexpr quint8 begin_symbol = grammar::symbol("begin");
+constexpr quint8 end_symbol = grammar::symbol("end");
 
-    __stack.push(Lexema("^", TokenType::Delimeter));
+} // namespace
+
+template <typename Next>
+bool Parser::parse(Next next, qsizetype size_hint) {
+    __revision = ~0ull;
+    __diagnostics.clear();
+    __recovering = false;
+    __stack.clear();
+    __stack.reserve(qMax(size_hint, (qsizetype)1024) + 2);
+    __ast.clear();
+    __ast.reserve(size_hint);
+    __semantic_analyzer.reset(__lexer);
+
+    Lexema current;
+    qint32 position = -1;
+    bool at_end = false;
+    auto advance = [&]() {
+        position++;
+        if (!next(current)) {
+            current = Lexema("$", TokenType::Delimeter)
+                          .setOffset((quint32)__lexer->get_source()->size());
+            at_end = true;
+        }
+    };
 
-    while (!__line.isEmpty()) {
+    /*
+        Panic mode: skip the input up to the next ";" or "end", pop the
+        stack down to the ";" or "begin" the broken statement started after
+        and stand an E in for it. The tree is not built any more once an
+        error was found.
+    */
+    qint32 recovered_at = -1;
+    auto recover = [&](const QString& message) {
+        __recovering = true;
 
-        Lexema stack_lex = __stack.top();
-        if(stack_lex.type() == TokenType::Nonterminal)
-            stack_lex = __stack.at(__stack.length()-2);
+        // A second error at the same token comes from the recovery itself.
+        if (position != recovered_at)
+            report(current, message);
+        else if (!at_end)
+            advance();
+        while (!at_end && current.grammar() != semicolon_symbol &&
+               current.grammar() != end_symbol)
+            advance();
+        recovered_at = position;
 
-        Lexema line_lex = __line.front();
+        while (__stack.size() > 1 && top_terminal().symbol != semicolon_symbol &&
+               top_terminal().symbol != begin_symbol)
+            __stack.removeLast();
 
-        if ((int)line_lex.type() & ((int)TokenType::Id | (int)TokenType::Const))
-            line_lex = Lexema::A();
+        if (at_end || __stack.size() == 1)
+            return false;
+        if (__stack.last().symbol != grammar::E)
+            __stack.push_back({grammar::E, position});
+        return true;
+    };
 
-        if (!(parser_rules.contains(line_lex.value()) &&
-              parser_rules[line_lex.value()].contains(stack_lex.value())))
-            throw std::runtime_error(QString("No realtion specified for: (%1, %2)")
-                                         .arg(line_lex.value())
-                                         .arg(stack_lex.value())
-                                         .toStdString());
+    advance();
 
-        int rel = parser_rules[line_lex.value()][stack_lex.value()];
+    __stack.push_back({grammar::BOTTOM, -1});
+
+    while (true) {
+
+        const StackEntry& stack_top = top_terminal();
+
+        qint8 rel = precedence::relation(current.grammar(), stack_top.symbol);
+
+        if (rel == precedence::none) {
+            std::string_view line = grammar::name(current.grammar());
+            std::string_view stack = grammar::name(stack_top.symbol);
+            if (!recover(QString("No realtion specified for: (%1, %2)")
+                             .arg(current.grammar() == grammar::NONE
+                                      ? current.value()
+                                      : QString::fromUtf8(line.data(), line.size()))
+                             .arg(QString::fromUtf8(stack.data(), stack.size()))))
+                break;
+            continue;
+        }
 
         if (rel <= 0) {
-            __stack.push(line_lex);
-            __line.pop_front();
+            shift(current, position);
+            if (at_end)
+                break;
+            advance();
         }
         else {
-            Rule the_best_rule = Rule();
-
-            foreach (auto& rule, rules) {
-                if (__stack.size() - 1 < rule.len())
-                    continue;
+            qint16 found = rule_trie.match(__stack.size() - 1, [&](qsizetype i) {
+                return __stack.at(__stack.size() - 1 - i).symbol;
+            });
 
-                if (rule.check_stack(&__stack))
-                    if (the_best_rule.len() < rule.len()) the_best_rule = rule;
+            if (found < 0) {
+                if (!recover("NoRuleForSequanceException"))
+                    break;
+                continue;
             }
 
-            if (the_best_rule.empty())
-                throw std::runtime_error("NoRuleForSequanceException");
+            reduce(found, position - 1);
+        }
+    }
+
+    if (__recovering) {
+        __ast.clear();
+        return 0;
+    }
+
+    __ast.finish(position);
+    __semantic_analyzer.finish();
+    __revision = __lexer->get_revision();
+    return 1;
+}
 
-            for (int i = 0; i < the_best_rule.len(); i++)
-                __stack.pop();
+/*!
+    Brings the tree up to date with an edit made by Lexer::update().
+    Only the statement the edit replaced is parsed again, between the
+    tokens that bound it, and its subtree is swapped for the new one; the
+    rest of the tree is reused. Anything that could make the result differ
+    from a full parse falls back to analyze().
+*/
+[[nodiscard]] bool Parser::update(const TokenEdit& edit) {
+    const TokenStore& tokens = __lexer->get_tokenized_code();
+
+    if (edit.full || edit.revision != __revision || __ast.isEmpty() ||
+        edit.removed == 0 || edit.added == 0 ||
+        edit.first == 0 || edit.first + edit.added >= tokens.size())
+        return analyze();
+
+    const qint32 first = (qint32)edit.first;
+    const qsizetype node = __ast.find(first, first + (qint32)edit.removed - 1);
+    const qsizetype declarations = __semantic_analyzer.declarationCount();
+    const qsizetype errors = __semantic_analyzer.errorCount();
+
+    // A declaration in the reparsed tokens could change any use after it.
+    if (node < 0 || !reparse(first, (qint32)edit.added) ||
+        __semantic_analyzer.declarationCount() != declarations)
+        return analyze();
+
+    __ast.replace(node, (qint32)(edit.added - edit.removed));
+    __semantic_analyzer.splice(first, (qint32)edit.removed, (qint32)edit.added, errors);
+    __revision = __lexer->get_revision();
+    return 1;
+}
 
-            __stack.push(the_best_rule());
+/*!
+    Parses count tokens at first on their own, with the token before them
+    as the stack bottom and the token after them as the end of input.
+    Succeeds if they reduce to a single E without a handle reaching down to
+    the bottom, which is exactly what a full parse would do with them.
+*/
+bool Parser::reparse(qint32 first, qint32 count) {
+    const TokenStore& tokens = __lexer->get_tokenized_code();
+    const qint32 stop = first + count;
 
-        rulewasfound:
+    __stack.clear();
+    __stack.push_back({tokens.at(first - 1).grammar(), first - 1});
+    __ast.start_subtree(count);
+    __semantic_analyzer.startReparse();
+
+    qint32 position = first;
+    Lexema current = tokens.at(position);
+
+    while (true) {
+        const StackEntry& stack_top = top_terminal();
+        if (position == stop && &stack_top == &__stack.first())
+            break;
+
+        qint8 rel = precedence::relation(current.grammar(), stack_top.symbol);
+        if (rel == precedence::none)
+            return false;
+
+        if (rel <= 0) {
+            if (position == stop)
+                return false;
+            shift(current, position);
+            current = tokens.at(++position);
+        }
+        else {
+            auto symbol_at = [&](qsizetype i) {
+                return __stack.at(__stack.size() - 1 - i).symbol;
+            };
+
+            if (rule_trie.reaches(__stack.size(), symbol_at))
+                return false;
+
+            qint16 found = rule_trie.match(__stack.size() - 1, symbol_at);
+            if (found < 0)
+                return false;
+
+            reduce(found, position - 1);
         }
     }
 
-    return 1;
+    return __stack.size() == 2 && __stack.last().symbol == grammar::E;
+}
+
+/*!
+    The topmost terminal of the stack; at most one E can be above it.
+*/
+const Parser::StackEntry& Parser::top_terminal() const {
+    return __stack.last().symbol == grammar::E ? __stack.at(__stack.size() - 2)
+                                               : __stack.last();
+}
+
+void Parser::shift(const Lexema& lex, qint32 position) {
+    __stack.push_back({lex.grammar(), position});
+    if (__recovering)
+        return;
+    if (lex.grammar() == grammar::A)
+        __ast.add_leaf(position);
+    __semantic_analyzer.shift(lex, position);
+}
+
+/*!
+    Replaces the handle of rule at the top of the stack with E, adds its
+    node to the tree and has the semantic analyzer check it; last is the
+    last token the handle covers.
+*/
+void Parser::reduce(qint16 rule, qint32 last) {
+    const Rule& reduced = rules[rule];
+    const qsizetype first = __stack.size() - reduced.length;
+    const StackEntry entry { grammar::E, __stack.at(first).token };
+
+    if (!__recovering) {
+        quint16 children = 0;
+        for (qsizetype i = first; i < __stack.size(); i++)
+            if (__stack.at(i).symbol == grammar::A || __stack.at(i).symbol == grammar::E)
+                children++;
+        __ast.add_node(rule, reduced.type, children, entry.token, last);
+        __semantic_analyzer.reduce(reduced.type, entry.token, last);
+    }
+
+    __stack.resize(first);
+    __stack.push_back(entry);
+}
+
+/*!
+    Records a syntax error at a token, or throws it with its location
+    unless diagnostics are collected.
+*/
+void Parser::report(const Lexema& at, const QString& message) {
+    if (!__collect_diagnostics)
+        throw std::runtime_error(QString("%1: %2").arg(location(at), message).toStdString());
+
+    __diagnostics.push_back({at.offset(), (quint32)at.text().size(), message});
+}
+
+/*!
+    Returns "file:line:col" of a token.
+*/
+QString Parser::location(const Lexema& lex) const {
+    return __lexer->get_source()->location(lex.offset());
 }
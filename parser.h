@@ -2,35 +2,63 @@
 #define PARSER_H
 
 #include "parser_rules.h"
+#include "ast.h"
 #include "sema.h"
 #include "lexer.h"
 
 class Parser
 {
-    Lexer* __lexer;
-    QStack<Lexema> __stack;
-    QList<Lexema> __line;
-    //QStack<QString> __conv_seq;
-    QList<QPair<QString, QList<Lexema>>> __conv_sequance;
+public:
+    /*!
+        Parse stack entry: a grammar symbol and the index in the input of
+        the first token it covers, -1 for the stack bottom.
+    */
+    struct StackEntry {
+        quint8 symbol;
+        qint32 token;
+    };
+
+private:
+    const Lexer* __lexer = nullptr;
+    QList<StackEntry> __stack;
+    Ast __ast;
+    quint64 __revision = ~0ull;
+    QList<Diagnostic> __diagnostics;
+    bool __collect_diagnostics = false;
+    bool __recovering = false;
     SemanticAnalyzer __semantic_analyzer;
 
+    template <typename Next>
+    bool parse(Next next, qsizetype size_hint);
+    bool reparse(qint32 first, qint32 count);
+
+    const StackEntry& top_terminal() const;
+    void shift(const Lexema& lex, qint32 position);
+    void reduce(qint16 rule, qint32 last);
+
+    void report(const Lexema& at, const QString& message);
+    QString location(const Lexema& lex) const;
 
 public:
-    Parser(Lexer* lex) : __lexer(lex) {};
+    Parser(const Lexer* lex) : __lexer(lex) {};
     Parser() {};
 
     [[nodiscard]] bool analyze();
+    [[nodiscard]] bool analyze(TokenStream& tokens);
+    [[nodiscard]] bool update(const TokenEdit& edit);
 
-    QStack<Lexema> stack() const { return __stack; }
-    QList<Lexema> line() const { return __line; }
-
-    QList<QPair<QString, QList<Lexema>>>
-        conv_sequance() const { return __conv_sequance; }
+    const QList<StackEntry>& stack() const { return __stack; }
+    const Ast& ast() const { return __ast; }
+    const QList<Diagnostic>& diagnostics() const { return __diagnostics; }
 
+    void set_collect_diagnostics(bool collect) { __collect_diagnostics = collect; }
+    bool is_collecting_diagnostics() const { return __collect_diagnostics; }
 
     bool hasSemanticErrors() const { return __semantic_analyzer.hasErrors(); }
     void printSemanticErrors() const { __semantic_analyzer.printErrors(); }
-    const QList<QString>& getSemanticErrors() const { return __semantic_analyzer.getErrors(); }
+    QList<QString> getSemanticErrors() const { return __semantic_analyzer.getErrors(); }
+    VariableTable& variables() { return __semantic_analyzer.getVariables(); }
+    const VariableTable& variables() const { return __semantic_analyzer.getVariables(); }
 
 };
 
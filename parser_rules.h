@@ -1,329 +1,24 @@
 #ifndef PARSER_RULES_H
 #define PARSER_RULES_H
 
-#include <QMap>
 #include <QString>
-#include <QStack>
+
+#include <array>
+#include <stdexcept>
 
 #include "lexer.h"
 
 /*!
+    Precedence relation between the terminal read from the input (line)
+    and the topmost terminal of the stack:
     1 - >.
     0 - =.
     -1 - <.
 */
-static QMap<QString, QMap<QString, int>> parser_rules = {
-    {
-        "program",
-        {
-         {"^", -1},
-         }
-    },
-    {
-        "var",
-        {
-         {"a", -1},
-         }
-    },
-    {
-        "int",
-        {
-         {"var", -1},
-         {",", 1},
-         {"a", 1},
-         }
-    },
-    {
-        "integer",
-        {
-         {"var", -1},
-         {",", 1},
-         {"a", 1},
-         }
-    },
-    {
-        "begin",
-        {
-         {"a", -1},
-         {"int", 1},
-         {"integer", 1},
-         {"begin", -1},
-         {";", -1},
-         {"else", -1},
-         {"then", -1},
-         {")", -1},
-         }
-    },
-    {
-        "end",
-        {
-         {";", 1},
-         {"end", 1},
-         {"begin", -1},
-         {"a" , 1},
-         {"*", 1},
-         {"/", 1},
-         {"-", 1},
-         {"+", 1},
-         {"=", 1},
-         {")", 1},
-         }
-    },
-    {
-        "input",
-        {
-         {"begin", -1},
-         {";", -1},
-         {"else", -1},
-         {"then", -1},
-         }
-    },
-    {
-        "output",
-        {
-         {"begin", -1},
-         {";", -1},
-         {"else", -1},
-         {"then", -1},
-
-         }
-    },
-    {
-        "for",
-        {
-         {"begin", -1},
-         {";", -1},
-         {"else", -1},
-         {"then", -1},
-
-         }
-    },
-    {
-        "while",
-        {
-         {"begin", -1},
-         {";", -1},
-         {"else", -1},
-         {"then", -1},
-
-         }
-    },
-    {
-        "if",
-        {
-         {"begin", -1},
-         {";", -1},
-         {"else", -1},
-         {"then", -1},
-
-         }
-    },
-    {
-        "let",
-        {
-         {"begin", -1},
-         {";", -1},
-         {"else", -1},
-         {"then", -1},
-
-         }
-    },
-    {
-        ";",
-        {
-         {"a", 1},
-         {"begin", -1},
-         {"end", 1},
-         {";", -1},
-         {",", 1},
-         {"*", 1},
-         {"/", 1},
-         {"-", 1},
-         {"+", 1},
-         {"=", 1},
-         {"else", 1},
-         {"then", 1},
-         {"(", -1},
-         {")", 1},
-         }
-    },
-    {
-        ",",
-        {
-         {"var", -1},
-         {",", -1},
-         {"*", 1},
-         {"/", 1},
-         {"-", 1},
-         {"+", 1},
-         {"a", 1},
-         {"(", -1},
-         {")", 1},
-         }
-    },
-    {
-        ".",
-        {
-         {"end", 0},
-         }
-    },
-    {
-        "*",
-        {
-         {"a", 1},
-         {"end", 1},
-         {";", -1},
-         {",", -1},
-         {"*", 1},
-         {"/", 1},
-         {"+", -1},
-         {"-", -1},
-         {"=", -1},
-         {"(", -1},
-         {")", 1},
-         }
-    },
-    {
-        "/",
-        {
-         {"a", 1},
-         {"end", 1},
-         {";", -1},
-         {",", -1},
-         {"*", 1},
-         {"/", 1},
-         {"+", -1},
-         {"-", -1},
-         {"=", -1},
-         {"(", -1},
-         {")", 1},
-         }
-    },
-    {
-        "+",
-        {
-         {"a", 1},
-         {"end", 1},
-         {";", -1},
-         {",", -1},
-         {"*", 1},
-         {"/", 1},
-         {"+", 1},
-         {"-", 1},
-         {"=", -1},
-         {"(", -1},
-         {")", 1},
-         }
-    },
-    {
-        "-",
-        {
-         {"a", 1},
-         {"end", 1},
-         {";", -1},
-         {",", -1},
-         {"*", 1},
-         {"/", 1},
-         {"+", 1},
-         {"-", 1},
-         {"=", -1},
-         {"(", -1},
-         {")", 1},
-         }
-    },
-    {
-        "=",
-        {
-         {"end", 1},
-         {"a", 0},
-         }
-    },
-    {
-        "else",
-        {
-         {"end", 1},
-         {"*", 1},
-         {"/", 1},
-         {"+", 1},
-         {"-", 1},
-         {"=", 1},
-         {")", 1},
-         {"else", 1},
-         {"then", -1},
-         {"a", 1},
-         {";", 1},
-         }
-    },
-    {
-        "then",
-        {
-         {")", -1},
-         {"end", 1},
-         {"else", -1},
-        }
-    },
-    {
-        "a",
-        {
-         {"program", 0},
-         {"var", -1},
-         {"let", 0},
-         {";", -1},
-         {",", -1},
-         {"*", -1},
-         {"/", -1},
-         {"+", -1},
-         {"-", -1},
-         {"=", -1},
-         {"(", -1},
-         }
-    },
-    {
-        "(",
-        {
-         {"input", 0},
-         {"output", 0},
-         {"for", 0},
-         {"while", 0},
-         {"if", 0},
-         {";", -1},
-         {",", -1},
-         {"*", -1},
-         {"/", -1},
-         {"+", -1},
-         {"-", -1},
-         {"=", -1},
-         {"(", -1},
-         }
-    },
-    {
-        ")",
-        {
-         {"a", 1},
-         {"end", 1},
-         {"(", 0},
-         {")", 1},
-         {";", -1},
-         {",", 1},
-         {"*", 1},
-         {"+", 1},
-         {"-", 1},
-         {"/", 1},
-         }
-    },
-    {
-        "^", //! Beginning
-        {
-
-        }
-    },
-    {
-        "$", //! Ending
-        {
-         {".", 1},
-         {"^", -1},
-         }
-    }
+struct PrecedenceRelation {
+    std::string_view line;
+    std::string_view stack;
+    qint8 relation;
 };
 
 enum class RuleType {
@@ -343,206 +38,139 @@ enum class RuleType {
     NEG,
 };
 
-class Rule {
-    QList<Lexema> __seq;
-    QString __name;
-    Lexema (*__return)();
-    RuleType __type;
-
-public:
-    Rule() : __name("???"), __type(RuleType::PROGRAM), __return([](){return Lexema("???", TokenType::Error);}) {};
-    Rule(QString name, RuleType type) : __name(name), __type(type), __return([](){return Lexema("???", TokenType::Error);}) {}
-
-    Rule& push_back(Lexema lex) {
-        __seq.push_back(lex);
-        return *this;
-    }
-
-    Rule& ret(Lexema (*ret)()) {
-        __return = ret;
-        return *this;
-    }
+/*!
+    A rule of the grammar: its handle, as grammar symbols, reduces to E.
+*/
+struct Rule {
+    static constexpr std::size_t max_handle = 16;
 
-    QString name() const { return __name; }
+    std::string_view name;
+    RuleType type;
+    quint8 length;
+    std::array<quint8, max_handle> handle;
+};
 
-    bool operator==(QList<Lexema>& seq) const {
-        if (__seq.length() != seq.length())
-            return false;
+/*!
+    Edge of the handle trie: reading symbol at node from leads to node to.
+*/
+struct RuleTrieEdge {
+    qint16 from;
+    quint8 symbol;
+    qint16 to;
+};
 
-        for (int i = 0; i < __seq.length(); i++)
-            if ((__seq.at(i).type() == TokenType::Id || __seq.at(i).type() == TokenType::Const) &&
-                (seq.at(i).type() == TokenType::Id || seq.at(i).type() == TokenType::Const))
-                    continue;
-            else
-                if (__seq.at(i) == seq.at(i))
-                    continue;
-                else
-                    return false;
+/*!
+    Handles of all rules in a trie keyed on grammar symbols and read from
+    the top of the stack down, so the longest rule matching the stack is
+    found in one walk as long as the handle. It is built at compile time
+    from the edges grammarc emits.
+*/
+template <std::size_t Nodes>
+class RuleTrie {
+    std::array<std::array<qint16, grammar::COUNT>, Nodes> __next {};
+    std::array<qint16, Nodes> __rule {};
 
-        return true;
+public:
+    template <std::size_t Edges>
+    constexpr RuleTrie(const RuleTrieEdge (&edges)[Edges], const qint16 (&rules)[Nodes]) {
+        for (auto& next : __next)
+            for (auto& node : next)
+                node = -1;
+
+        for (const RuleTrieEdge& edge : edges) {
+            if (edge.symbol >= grammar::COUNT)
+                throw "grammar_tables.h: rule with a non grammar symbol";
+            __next[edge.from][edge.symbol] = edge.to;
+        }
+        for (std::size_t i = 0; i < Nodes; i++)
+            __rule[i] = rules[i];
     }
 
-    bool check_stack(QStack<Lexema>* stack) const {
-        if (stack->length() < len())
-            return false;
-
-        for (int i = 0; i < len(); i++) {
-            qsizetype stack_index = stack->length() - len() + i;
-            if ((__seq.at(i).type() == TokenType::Id || __seq.at(i).type() == TokenType::Const) &&
-                (stack->at(stack_index).type() == TokenType::Id || stack->at(stack_index).type() == TokenType::Const))
-                continue;
-            else
-                if (__seq.at(i) == stack->at(stack_index))
-                    continue;
-                else
-                    return false;
+    /*!
+        Returns the index of the longest rule whose handle ends at the top
+        of the stack, -1 if none matches. symbol_at(i) gives the grammar
+        symbol i entries below the top; at most depth entries are read.
+    */
+    template <typename SymbolAt>
+    constexpr qint16 match(qsizetype depth, SymbolAt symbol_at) const {
+        qint16 node = 0;
+        qint16 found = -1;
+
+        for (qsizetype i = 0; i < depth; i++) {
+            quint8 symbol = symbol_at(i);
+            if (symbol >= grammar::COUNT || (node = __next[node][symbol]) < 0)
+                break;
+            if (__rule[node] >= 0)
+                found = __rule[node];
         }
+        return found;
+    }
 
+    /*!
+        Returns true if the depth symbols from the top are all on the path
+        of some handle, i.e. a handle could take in symbols below them.
+    */
+    template <typename SymbolAt>
+    constexpr bool reaches(qsizetype depth, SymbolAt symbol_at) const {
+        qint16 node = 0;
+
+        for (qsizetype i = 0; i < depth; i++) {
+            quint8 symbol = symbol_at(i);
+            if (symbol >= grammar::COUNT || (node = __next[node][symbol]) < 0)
+                return false;
+        }
         return true;
     }
-
-    bool empty() const { return __seq.empty(); }
-
-    qsizetype len() const { return __seq.length(); }
-
-    Lexema operator()() { return __return(); }
-
-    RuleType type() const { return __type; }
 };
 
-inline QList<Rule> rules = {
-    Rule("program", RuleType::PROGRAM)
-        .push_back(Lexema::PROGRAM())
-        .push_back(Lexema::A())
-        .push_back(Lexema::E())
-        .push_back(Lexema::BEGIN())
-        .push_back(Lexema::E())
-        .push_back(Lexema::END())
-        .push_back(Lexema::DOT())
-        .ret(Lexema::E),
-
-    Rule("description", RuleType::VAR).push_back(Lexema::VAR())
-        .push_back(Lexema::E())
-        .push_back(Lexema::INT())
-        .ret(Lexema::E),
-
-    Rule("atoms", RuleType::E).push_back(Lexema::E())
-        .push_back(Lexema::COM())
-        .push_back(Lexema::E())
-        .ret(Lexema::E),
-
-    Rule("block_op", RuleType::BLOCK).push_back(Lexema::BEGIN())
-        .push_back(Lexema::E())
-        .push_back(Lexema::END())
-        .ret(Lexema::E),
-
-    Rule("input_op", RuleType::IN).push_back(Lexema::INPUT())
-        .push_back(Lexema::LPAR())
-        .push_back(Lexema::E())
-        .push_back(Lexema::RPAR())
-        .ret(Lexema::E),
-
-    Rule("output_op", RuleType::OUT).push_back(Lexema::OUTPUT())
-        .push_back(Lexema::LPAR())
-        .push_back(Lexema::E())
-        .push_back(Lexema::RPAR())
-        .ret(Lexema::E),
-
-    Rule("for_op", RuleType::FOR).push_back(Lexema::FOR())
-        .push_back(Lexema::LPAR())
-        .push_back(Lexema::E())
-        .push_back(Lexema::SEMICOLON())
-        .push_back(Lexema::E())
-        .push_back(Lexema::SEMICOLON())
-        .push_back(Lexema::E())
-        .push_back(Lexema::RPAR())
-        .push_back(Lexema::E())
-        .ret(Lexema::E),
+// Tables generated from dsl.grammar by grammarc; see CMakeLists.txt.
+#include "grammar_tables.h"
 
-    Rule("while_op", RuleType::WHILE).push_back(Lexema::WHILE())
-        .push_back(Lexema::LPAR())
-        .push_back(Lexema::E())
-        .push_back(Lexema::RPAR())
-        .push_back(Lexema::E())
-        .ret(Lexema::E),
+inline constexpr auto& rules = generated::rules;
 
-    Rule("if_op", RuleType::IF).push_back(Lexema::IF())
-        .push_back(Lexema::LPAR())
-        .push_back(Lexema::E())
-        .push_back(Lexema::RPAR())
-        .push_back(Lexema::THEN())
-        .push_back(Lexema::E())
-        .ret(Lexema::E),
-
-    Rule("if-else_op", RuleType::IF_ELSE).push_back(Lexema::IF())
-        .push_back(Lexema::LPAR())
-        .push_back(Lexema::E())
-        .push_back(Lexema::RPAR())
-        .push_back(Lexema::THEN())
-        .push_back(Lexema::E())
-        .push_back(Lexema::ELSE())
-        .push_back(Lexema::E())
-        .ret(Lexema::E),
-
-    Rule("definition_op", RuleType::LET).push_back(Lexema::LET())
-        .push_back(Lexema::A())
-        .push_back(Lexema::EQU())
-        .push_back(Lexema::E())
-        .ret(Lexema::E),
-
-    Rule("ops", RuleType::E).push_back(Lexema::E())
-        .push_back(Lexema::SEMICOLON())
-        .push_back(Lexema::E())
-        .ret(Lexema::E),
-
-    //Rule("exprs").push_back(Lexema::E())
-    //    .push_back(Lexema::COM())
-    //    .push_back(Lexema::E())
-    //    .ret(Lexema::E),
-
-    Rule("term_sum", RuleType::EXPR).push_back(Lexema::E())
-        .push_back(Lexema::SUM())
-        .push_back(Lexema::E())
-        .ret(Lexema::E),
-
-    Rule("term_dif", RuleType::EXPR).push_back(Lexema::E())
-        .push_back(Lexema::DIF())
-        .push_back(Lexema::E())
-        .ret(Lexema::E),
-
-    //Rule("term").push_back(Lexema::E())
-    //    .ret(Lexema::E),
-
-    //Rule("factor").push_back(Lexema::E())
-    //    .ret(Lexema::E),
-
-    //Rule("atom").push_back(Lexema::A())
-    //    .ret(Lexema::T),
+/*!
+    The relations of dsl.grammar compiled into a dense matrix indexed by
+    the grammar symbols of the line and stack terminals, so every parser
+    decision is a single array lookup. Pairs without a relation hold precedence::none.
+*/
+namespace precedence {
+
+constexpr qint8 none = 2;
+
+using Matrix = std::array<std::array<qint8, grammar::TERMINALS>, grammar::TERMINALS>;
+
+constexpr Matrix make_matrix() {
+    Matrix matrix {};
+    for (auto& row : matrix)
+        for (auto& cell : row)
+            cell = none;
+
+    for (const auto& r : generated::relations) {
+        quint8 line = grammar::symbol(r.line);
+        quint8 stack = grammar::symbol(r.stack);
+        if (line >= grammar::TERMINALS || stack >= grammar::TERMINALS)
+            throw "grammar_tables.h: unknown terminal";
+        if (matrix[line][stack] != none)
+            throw "grammar_tables.h: conflicting relations";
+        matrix[line][stack] = r.relation;
+    }
+    return matrix;
+}
 
-    Rule("factor_mul", RuleType::EXPR).push_back(Lexema::E())
-        .push_back(Lexema::MUL())
-        .push_back(Lexema::E())
-        .ret(Lexema::E),
+constexpr Matrix matrix = make_matrix();
 
-    Rule("factor_div", RuleType::EXPR).push_back(Lexema::E())
-        .push_back(Lexema::DIV())
-        .push_back(Lexema::E())
-        .ret(Lexema::E),
+constexpr qint8 relation(quint8 line, quint8 stack) {
+    return (line < grammar::TERMINALS && stack < grammar::TERMINALS)
+               ? matrix[line][stack] : none;
+}
 
-    Rule("atom_pars", RuleType::EXPR).push_back(Lexema::LPAR())
-        .push_back(Lexema::E())
-        .push_back(Lexema::RPAR())
-        .ret(Lexema::E),
+} // namespace precedence
 
-    //Rule("ids").push_back(Lexema::E())
-    //    .ret(Lexema::E),
+static_assert(precedence::relation(grammar::symbol("program"), grammar::BOTTOM) == -1);
+static_assert(precedence::relation(grammar::BOTTOM, grammar::BOTTOM) == precedence::none);
 
-    Rule("atom", RuleType::E).push_back(Lexema::A())
-        .ret(Lexema::E),
+inline constexpr RuleTrie rule_trie(generated::rule_trie_edges, generated::rule_trie_rules);
 
-    Rule("neg_num", RuleType::NEG).push_back(Lexema::DIF())
-        .push_back(Lexema::E())
-        .ret(Lexema::E),
-};
+static_assert(rule_trie.match(1, [](qsizetype) { return grammar::A; }) >= 0);
 
 #endif // PARSER_RULES_H
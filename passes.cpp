@@ -0,0 +1,204 @@
+#include "passes.h"
+
+#include <QElapsedTimer>
+#include <QStringList>
+
+#include <limits>
+#include <stdexcept>
+
+namespace ir {
+
+/*!
+    A phi of one value and itself is that value: a loop whose body never
+    changes a variable after all, or an if whose branches both leave it
+    alone. Replacing one phi can make another trivial, so this repeats
+    until nothing changes.
+*/
+bool simplify_phis(Function& function) {
+    std::vector<Value> replacement;
+    bool changed = false;
+    bool again = true;
+
+    while (again) {
+        again = false;
+        replacement.assign(function.size(), no_value);
+
+        for (Block b = 0; b < function.block_count(); b++) {
+            for (Value phi : function.block(b).instructions) {
+                if (function.at(phi).op != Opcode::Phi)
+                    break;
+                if (function.at(phi).erased)
+                    continue;
+
+                Value same = no_value;
+                bool trivial = true;
+                for (qsizetype i = 0; i < function.operand_count(phi) && trivial; i++) {
+                    const Value operand = function.operand(phi, i);
+                    if (operand == phi || operand == same)
+                        continue;
+                    if (same != no_value)
+                        trivial = false;
+                    same = operand;
+                }
+                if (!trivial || same == no_value)
+                    continue;
+
+                replacement[phi] = same;
+                function.erase(phi);
+                again = true;
+            }
+        }
+
+        if (again) {
+            function.replace_uses(replacement);
+            changed = true;
+        }
+    }
+
+    if (changed)
+        function.compact();
+    return changed;
+}
+
+/*!
+    Blocks are laid out so that every operand outside a phi is defined in
+    an earlier block or earlier in the same one, so a single sweep sees
+    the folded operands of an instruction before the instruction. The
+    arithmetic wraps like the x86 instructions it stands for; division by
+    zero and the one quotient that overflows are left to fault at run time
+    as they did before.
+*/
+bool fold_constants(Function& function) {
+    auto constant = [&](Value value, qint32& immediate) {
+        if (function.at(value).op != Opcode::Const)
+            return false;
+        immediate = function.at(value).immediate;
+        return true;
+    };
+
+    bool changed = false;
+    for (Block b = 0; b < function.block_count(); b++) {
+        for (Value value : function.block(b).instructions) {
+            Instruction& instruction = function.at(value);
+            const Opcode op = instruction.op;
+            if (op != Opcode::Copy && !is_arithmetic(op))
+                continue;
+
+            qint32 a = 0, c = 0;
+            if (!constant(function.operand(value, 0), a))
+                continue;
+            if (instruction.operand_count > 1 && !constant(function.operand(value, 1), c))
+                continue;
+
+            quint32 result;
+            switch (op) {
+            case Opcode::Copy: result = (quint32)a; break;
+            case Opcode::Neg: result = 0u - (quint32)a; break;
+            case Opcode::Add: result = (quint32)a + (quint32)c; break;
+            case Opcode::Sub: result = (quint32)a - (quint32)c; break;
+            case Opcode::Mul: result = (quint32)a * (quint32)c; break;
+            case Opcode::Div:
+                if (c == 0 || (a == std::numeric_limits<qint32>::min() && c == -1))
+                    continue;
+                result = (quint32)(a / c);
+                break;
+            default:
+                continue;
+            }
+
+            instruction.op = Opcode::Const;
+            instruction.operand_count = 0;
+            instruction.immediate = (qint32)result;
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+bool eliminate_dead_code(Function& function) {
+    std::vector<char> live(function.size(), 0);
+    std::vector<Value> work;
+
+    for (Block b = 0; b < function.block_count(); b++)
+        for (Value value : function.block(b).instructions)
+            if (has_side_effects(function.at(value).op)) {
+                live[value] = 1;
+                work.push_back(value);
+            }
+
+    while (!work.empty()) {
+        const Value value = work.back();
+        work.pop_back();
+        for (qsizetype i = 0; i < function.operand_count(value); i++) {
+            const Value operand = function.operand(value, i);
+            if (operand != no_value && !live[operand]) {
+                live[operand] = 1;
+                work.push_back(operand);
+            }
+        }
+    }
+
+    bool changed = false;
+    for (Block b = 0; b < function.block_count(); b++)
+        for (Value value : function.block(b).instructions)
+            if (!live[value]) {
+                function.erase(value);
+                changed = true;
+            }
+
+    if (changed)
+        function.compact();
+    return changed;
+}
+
+PassManager PassManager::standard() {
+    PassManager manager;
+    manager.add("simplify-phis", simplify_phis);
+    manager.add("fold-constants", fold_constants);
+    // Folding turns copies into constants, which can make phis trivial
+    manager.add("simplify-phis", simplify_phis);
+    manager.add("dce", eliminate_dead_code);
+    return manager;
+}
+
+void PassManager::run(Function& function) {
+    if (__verify) {
+        const QList<QString> problems = verify(function);
+        if (!problems.isEmpty())
+            throw std::runtime_error(
+                QString("IR verification failed before the passes: %1")
+                    .arg(problems.first()).toStdString());
+    }
+
+    QElapsedTimer timer;
+    for (Pass& pass : __passes) {
+        timer.start();
+        const bool changed = pass.run(function);
+        pass.nanoseconds += timer.nsecsElapsed();
+        pass.runs++;
+        if (!changed)
+            continue;
+        pass.changes++;
+
+        if (__verify) {
+            const QList<QString> problems = verify(function);
+            if (!problems.isEmpty())
+                throw std::runtime_error(
+                    QString("IR verification failed after %1: %2")
+                        .arg(pass.name, problems.first()).toStdString());
+        }
+    }
+}
+
+QString PassManager::report() const {
+    QStringList lines;
+    for (const Pass& pass : __passes)
+        lines.append(QString("%1: %2 runs, %3 changed, %4 us")
+            .arg(pass.name)
+            .arg(pass.runs)
+            .arg(pass.changes)
+            .arg(pass.nanoseconds / 1000));
+    return lines.join("\n");
+}
+
+} // namespace ir
@@ -0,0 +1,56 @@
+#ifndef PASSES_H
+#define PASSES_H
+
+#include "ir.h"
+
+#include <QList>
+#include <QString>
+
+namespace ir {
+
+//! Removes phis whose operands are all one value or the phi itself.
+bool simplify_phis(Function& function);
+//! Evaluates arithmetic on constants, except what would trap at run time.
+bool fold_constants(Function& function);
+//! Erases instructions whose values nothing uses.
+bool eliminate_dead_code(Function& function);
+
+/*!
+    Runs passes over a Function in order. A pass returns whether it
+    changed anything; with verification on, the function is checked after
+    every pass that did and a broken one throws, naming the pass.
+*/
+class PassManager {
+public:
+    using Run = bool (*)(Function&);
+
+    struct Pass {
+        const char* name;
+        Run run;
+        qsizetype runs = 0;
+        qsizetype changes = 0;
+        qint64 nanoseconds = 0;
+    };
+
+private:
+    QList<Pass> __passes;
+    bool __verify = false;
+
+public:
+    PassManager() = default;
+
+    //! simplify-phis, fold-constants, simplify-phis again and dce.
+    static PassManager standard();
+
+    void add(const char* name, Run run) { __passes.append({name, run}); }
+    void set_verify(bool verify) { __verify = verify; }
+
+    void run(Function& function);
+
+    const QList<Pass>& passes() const { return __passes; }
+    QString report() const;
+};
+
+} // namespace ir
+
+#endif // PASSES_H
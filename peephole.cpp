@@ -0,0 +1,218 @@
+#include "peephole.h"
+
+#include <QHash>
+#include <QStringList>
+
+#include <vector>
+
+QString AsmLine::toString() const {
+    switch (kind) {
+    case Kind::Label:
+        return op + ":";
+    case Kind::Comment:
+        return "    ; " + op;
+    case Kind::Blank:
+        return QString();
+    case Kind::Directive:
+        return op;
+    case Kind::Instruction:
+        break;
+    }
+
+    QString line = "    " + op;
+    if (!target.isEmpty())
+        line += " " + target;
+    if (!source.isEmpty())
+        line += ", " + source;
+    if (!comment.isEmpty())
+        line = (line + " ").leftJustified(24) + "; " + comment;
+    return line;
+}
+
+namespace {
+
+bool isRegister32(const QString& operand) {
+    static const char* const names[] = {"eax", "ebx", "ecx", "edx", "esi", "edi", "ebp", "esp"};
+    for (const char* name : names)
+        if (operand == name)
+            return true;
+    return false;
+}
+
+bool isRegister(const QString& operand) {
+    static const char* const names[] = {"al", "bl", "cl", "dl"};
+    for (const char* name : names)
+        if (operand == name)
+            return true;
+    return isRegister32(operand);
+}
+
+bool isMemory(const QString& operand) { return operand.startsWith('['); }
+
+//! jmp and the conditional jumps, which all start with j.
+bool isJump(const AsmLine& line) {
+    return line.kind == AsmLine::Kind::Instruction && line.op.startsWith('j');
+}
+
+bool isSkipped(const AsmLine& line) {
+    return line.kind == AsmLine::Kind::Comment || line.kind == AsmLine::Kind::Blank;
+}
+
+} // namespace
+
+const char* PeepholeOptimizer::rule_name(Rule rule) {
+    switch (rule) {
+    case StoreLoad: return "store-load";
+    case DeadMove: return "dead-move";
+    case JumpToNext: return "jump-to-next";
+    case JumpChain: return "jump-chain";
+    case CompareZero: return "compare-zero";
+    case RULES: break;
+    }
+    return "?";
+}
+
+qsizetype PeepholeOptimizer::run(QList<AsmLine>& code) {
+    const qsizetype removed = __removed;
+    bool changed = true;
+    while (changed) {
+        changed = retargetJumps(code);
+        changed = sweep(code) || changed;
+    }
+    return __removed - removed;
+}
+
+/*!
+    A jump to a label that is followed by a jmp goes where the jmp goes,
+    through as many jmps as there are; a loop of jmps is left alone.
+*/
+bool PeepholeOptimizer::retargetJumps(QList<AsmLine>& code) {
+    QHash<QString, qsizetype> labels;
+    for (qsizetype i = 0; i < code.size(); i++)
+        if (code.at(i).kind == AsmLine::Kind::Label)
+            labels.insert(code.at(i).op, i);
+
+    // The jmp a label leads to, -1 if it leads to anything else
+    auto jumpAt = [&](const QString& label) -> qsizetype {
+        qsizetype i = labels.value(label, -1);
+        if (i < 0)
+            return -1;
+        i++;
+        while (i < code.size() && (isSkipped(code.at(i)) || code.at(i).kind == AsmLine::Kind::Label))
+            i++;
+        return i < code.size() && isJump(code.at(i)) && code.at(i).op == "jmp" ? i : -1;
+    };
+
+    bool changed = false;
+    for (AsmLine& line : code) {
+        if (!isJump(line))
+            continue;
+
+        QString target = line.target;
+        qsizetype hops = 0;
+        for (qsizetype at = jumpAt(target); at >= 0 && hops <= labels.size(); at = jumpAt(target)) {
+            target = code.at(at).target;
+            hops++;
+        }
+        if (hops > labels.size() || target == line.target)
+            continue;
+
+        line.target = target;
+        __counts[JumpChain]++;
+        changed = true;
+    }
+    return changed;
+}
+
+/*!
+    One pass of the rules that look at an instruction and the one after
+    it. Removed lines are only marked until the end of the pass.
+*/
+bool PeepholeOptimizer::sweep(QList<AsmLine>& code) {
+    std::vector<char> dead(code.size(), 0);
+    bool changed = false;
+
+    auto next = [&](qsizetype i) {
+        i++;
+        while (i < code.size() && (dead[i] || isSkipped(code.at(i))))
+            i++;
+        return i;
+    };
+    auto remove = [&](qsizetype i, Rule rule) {
+        dead[i] = 1;
+        __counts[rule]++;
+        __removed++;
+        changed = true;
+    };
+
+    for (qsizetype i = 0; i < code.size(); i++) {
+        if (dead[i] || code.at(i).kind != AsmLine::Kind::Instruction)
+            continue;
+        AsmLine& line = code[i];
+
+        if (line.op == "mov" && line.target == line.source) {
+            remove(i, DeadMove);
+            continue;
+        }
+
+        // Only before a jump, which never reads AF: test leaves AF
+        // undefined where cmp clears it
+        if (line.op == "cmp" && isRegister(line.target) && line.source == "0" &&
+            next(i) < code.size() && isJump(code.at(next(i)))) {
+            line.op = "test";
+            line.source = line.target;
+            __counts[CompareZero]++;
+            changed = true;
+        }
+
+        if (isJump(line)) {
+            qsizetype k = next(i);
+            while (k < code.size() && code.at(k).kind == AsmLine::Kind::Label && code.at(k).op != line.target)
+                k = next(k);
+            if (k < code.size() && code.at(k).kind == AsmLine::Kind::Label) {
+                remove(i, JumpToNext);
+                continue;
+            }
+        }
+
+        const qsizetype j = next(i);
+        if (j >= code.size() || code.at(j).kind != AsmLine::Kind::Instruction)
+            continue;
+        AsmLine& after = code[j];
+
+        // mov [x], r: the next instruction may read r instead of [x]
+        if (line.op == "mov" && isMemory(line.target) && isRegister32(line.source) &&
+            after.source == line.target) {
+            if (after.op == "mov" && after.target == line.source)
+                remove(j, StoreLoad);
+            else {
+                after.source = line.source;
+                __counts[StoreLoad]++;
+                changed = true;
+            }
+            continue;
+        }
+
+        // mov r, x then mov r, y that does not read r: the first is dead
+        if (line.op == "mov" && isRegister32(line.target) && after.op == "mov" &&
+            after.target == line.target && !after.source.contains(line.target))
+            remove(i, DeadMove);
+    }
+
+    if (changed) {
+        qsizetype at = 0;
+        for (qsizetype i = 0; i < code.size(); i++)
+            if (!dead[i])
+                code[at++] = code.at(i);
+        code.resize(at);
+    }
+    return changed;
+}
+
+QString PeepholeOptimizer::report() const {
+    QStringList lines;
+    lines.append(QString("Peephole: %1 instructions removed").arg(__removed));
+    for (int rule = 0; rule < RULES; rule++)
+        lines.append(QString("    %1: %2").arg(rule_name(Rule(rule))).arg(__counts[rule]));
+    return lines.join("\n");
+}
@@ -0,0 +1,68 @@
+#ifndef PEEPHOLE_H
+#define PEEPHOLE_H
+
+#include <QList>
+#include <QString>
+
+/*!
+    One line of generated assembly. An instruction keeps its mnemonic and
+    operands apart, so rewriting it does not mean parsing text back;
+    labels, comments, blank lines and directives are kept as lines of
+    their own so they come out where they were emitted.
+*/
+struct AsmLine {
+    enum class Kind : quint8 {
+        Instruction,
+        Label,
+        Comment,
+        Blank,
+        Directive,  // written as is: sections, declarations
+    };
+
+    Kind kind;
+    QString op;         // mnemonic, label name, comment or directive text
+    QString target;     // first operand
+    QString source;     // second operand
+    QString comment;    // trailing comment of an instruction
+
+    QString toString() const;
+};
+
+/*!
+    Rewrites short windows of instructions into cheaper ones. A label
+    ends every window, since control may arrive there from elsewhere;
+    comments and blank lines are skipped over. The rules run until none
+    applies, and each counts how often it did.
+*/
+class PeepholeOptimizer {
+public:
+    enum Rule {
+        StoreLoad,      // mov [x], r then a read of [x]: read r instead
+        DeadMove,       // mov r, r, or a mov to r overwritten before it is read
+        JumpToNext,     // a jump to the label right after it
+        JumpChain,      // a jump to a jmp: jump to where that one goes
+        CompareZero,    // cmp r, 0 before a jump to test r, r
+        RULES
+    };
+
+private:
+    qsizetype __counts[RULES] = {};
+    qsizetype __removed = 0;
+
+    bool retargetJumps(QList<AsmLine>& code);
+    bool sweep(QList<AsmLine>& code);
+
+public:
+    PeepholeOptimizer() = default;
+
+    static const char* rule_name(Rule rule);
+
+    //! Optimizes code in place and returns how many instructions it removed.
+    qsizetype run(QList<AsmLine>& code);
+
+    qsizetype count(Rule rule) const { return __counts[rule]; }
+    qsizetype removed() const { return __removed; }
+    QString report() const;
+};
+
+#endif // PEEPHOLE_H
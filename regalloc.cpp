@@ -0,0 +1,248 @@
+#include "regalloc.h"
+
+#include <algorithm>
+
+namespace ir {
+
+void LinearScan::run(const std::vector<char>& folded) {
+    number();
+    buildIntervals(folded);
+    allocate();
+    findLiveRegisters();
+}
+
+/*!
+    Positions and loop depths. The builder lays a loop out from its
+    condition block to its latch, with the latch jumping back, so every
+    backward edge spans exactly the blocks of one loop.
+*/
+void LinearScan::number() {
+    const qsizetype blocks = __function->block_count();
+    __position.assign(__function->size(), -1);
+    __block_start.assign(blocks, 0);
+    __block_end.assign(blocks, 0);
+
+    qint32 position = 0;
+    for (Block block = 0; block < blocks; block++) {
+        __block_start[block] = position;
+        for (Value value : __function->block(block).instructions) {
+            __position[value] = position;
+            position += 2;
+        }
+        __block_end[block] = qMax(__block_start[block], position - 2);
+    }
+
+    std::vector<qint32> difference(blocks + 1, 0);
+    for (Block block = 0; block < blocks; block++)
+        for (Block successor : __function->block(block).successors)
+            if (successor <= block) {
+                difference[successor]++;
+                difference[block + 1]--;
+            }
+
+    __depth.assign(blocks, 0);
+    qint32 depth = 0;
+    for (Block block = 0; block < blocks; block++) {
+        depth += difference[block];
+        __depth[block] = depth;
+    }
+}
+
+void LinearScan::buildIntervals(const std::vector<char>& folded) {
+    const Function& function = *__function;
+    const qsizetype size = function.size();
+
+    struct Use {
+        Block block;
+        qint32 position;    // -1 if the value is used as it leaves the block
+    };
+
+    // Where the expression a folded value is part of is used: the
+    // position of the first instruction up its chain of users that is
+    // not folded. Users come later in the block, so a backward sweep
+    // sees them first.
+    std::vector<qint32> used_at(size, -1);
+    std::vector<qint32> uses_of(size + 1, 0);
+    __interval.assign(size, -1);
+    __intervals.clear();
+
+    auto needs_interval = [&](Value value) {
+        const Instruction& instruction = function.at(value);
+        return !folded[value] && instruction.type == Type::I32 && instruction.op != Opcode::Const;
+    };
+
+    for (Block block = 0; block < function.block_count(); block++) {
+        const QList<Value>& instructions = function.block(block).instructions;
+        for (qsizetype i = instructions.size() - 1; i >= 0; i--) {
+            const Value user = instructions.at(i);
+            const qint32 position = folded[user] ? used_at[user] : __position[user];
+            for (qsizetype k = 0; k < function.operand_count(user); k++) {
+                const Value operand = function.operand(user, k);
+                if (folded[operand])
+                    used_at[operand] = position;
+                else if (needs_interval(operand))
+                    uses_of[operand + 1]++;
+            }
+        }
+        for (Value value : instructions)
+            if (needs_interval(value)) {
+                __interval[value] = (qint32)__intervals.size();
+                const qint32 start = function.at(value).op == Opcode::Phi
+                    ? __block_start[block] : __position[value];
+                __intervals.push_back({value, start, start});
+            }
+    }
+
+    // Uses grouped by value, so the walks for one value can share marks
+    for (qsizetype value = 0; value < size; value++)
+        uses_of[value + 1] += uses_of[value];
+    std::vector<Use> uses(uses_of[size]);
+    std::vector<qint32> filled(uses_of.begin(), uses_of.end() - 1);
+
+    for (Block block = 0; block < function.block_count(); block++) {
+        for (Value user : function.block(block).instructions) {
+            const bool phi = function.at(user).op == Opcode::Phi;
+            const qint32 position = folded[user] ? used_at[user] : __position[user];
+            for (qsizetype k = 0; k < function.operand_count(user); k++) {
+                const Value operand = function.operand(user, k);
+                if (folded[operand] || !needs_interval(operand))
+                    continue;
+                // A phi reads its operand at the end of the matching predecessor
+                uses[filled[operand]++] = phi
+                    ? Use{function.block(block).predecessors.at(k), -1}
+                    : Use{block, position};
+            }
+        }
+    }
+
+    std::vector<Value> marked(function.block_count(), no_value);
+    std::vector<Block> work;
+
+    for (LiveInterval& interval : __intervals) {
+        const Value value = interval.value;
+        const Block definition = function.at(value).block;
+        float weight = 1;
+        for (qsizetype depth = 0; depth < qMin(__depth[definition], 6); depth++)
+            weight *= 10;
+
+        // The value is live into every block on a path from a use up to
+        // the definition, and so live out of their predecessors.
+        auto live_out = [&](Block block) {
+            interval.end = qMax(interval.end, __block_end[block] + 1);
+            if (block != definition && marked[block] != value) {
+                marked[block] = value;
+                work.push_back(block);
+            }
+        };
+
+        for (qint32 i = uses_of[value]; i < uses_of[value + 1]; i++) {
+            const Use& use = uses[i];
+            float use_weight = 1;
+            for (qsizetype depth = 0; depth < qMin(__depth[use.block], 6); depth++)
+                use_weight *= 10;
+            weight += use_weight;
+
+            if (use.position < 0)
+                live_out(use.block);
+            else {
+                interval.end = qMax(interval.end, use.position);
+                if (use.block != definition && marked[use.block] != value) {
+                    marked[use.block] = value;
+                    work.push_back(use.block);
+                }
+            }
+
+            while (!work.empty()) {
+                const Block block = work.back();
+                work.pop_back();
+                for (Block predecessor : function.block(block).predecessors)
+                    live_out(predecessor);
+            }
+        }
+
+        interval.weight = weight / (interval.end - interval.start + 1);
+    }
+}
+
+void LinearScan::allocate() {
+    std::vector<qint32> active;         // indices of intervals in registers, by end
+    std::vector<char> taken(__registers, 0);
+    __spilled = 0;
+
+    auto by_end = [&](qint32 a, qint32 b) { return __intervals[a].end < __intervals[b].end; };
+
+    for (qint32 current = 0; current < (qint32)__intervals.size(); current++) {
+        LiveInterval& interval = __intervals[current];
+
+        // Intervals that ended give their registers back; one that ends
+        // where this one starts is read by the instruction defining it
+        qsizetype expired = 0;
+        while (expired < (qsizetype)active.size() &&
+               __intervals[active[expired]].end <= interval.start) {
+            taken[__intervals[active[expired]].reg] = 0;
+            expired++;
+        }
+        active.erase(active.begin(), active.begin() + expired);
+
+        int reg = 0;
+        while (reg < __registers && taken[reg])
+            reg++;
+
+        if (reg == __registers) {
+            qsizetype lightest = -1;
+            float weight = interval.weight;
+            for (qsizetype i = 0; i < (qsizetype)active.size(); i++)
+                if (__intervals[active[i]].weight < weight) {
+                    weight = __intervals[active[i]].weight;
+                    lightest = i;
+                }
+
+            __spilled++;
+            if (lightest < 0)
+                continue;
+
+            LiveInterval& spilled = __intervals[active[lightest]];
+            reg = spilled.reg;
+            spilled.reg = -1;
+            active.erase(active.begin() + lightest);
+        }
+
+        interval.reg = (qint8)reg;
+        taken[reg] = 1;
+        active.insert(std::upper_bound(active.begin(), active.end(), current, by_end), current);
+    }
+}
+
+/*!
+    For every instruction, the registers that hold values around it.
+    Intervals in one register never overlap, so the only candidate in a
+    register is the last interval that started in it before the
+    instruction.
+*/
+void LinearScan::findLiveRegisters() {
+    __live_through.assign(__function->size(), 0);
+    __live_at.assign(__function->size(), 0);
+    std::vector<qint32> holder(__registers, -1);
+    qsizetype next = 0;
+
+    for (Block block = 0; block < __function->block_count(); block++) {
+        for (Value value : __function->block(block).instructions) {
+            const qint32 position = __position[value];
+            while (next < (qsizetype)__intervals.size() && __intervals[next].start < position) {
+                if (__intervals[next].reg >= 0)
+                    holder[__intervals[next].reg] = (qint32)next;
+                next++;
+            }
+            for (int reg = 0; reg < __registers; reg++) {
+                const qint32 index = holder[reg];
+                if (index < 0 || __intervals[index].end < position)
+                    continue;
+                __live_at[value] |= 1u << reg;
+                if (__intervals[index].end > position)
+                    __live_through[value] |= 1u << reg;
+            }
+        }
+    }
+}
+
+} // namespace ir
@@ -0,0 +1,86 @@
+#ifndef REGALLOC_H
+#define REGALLOC_H
+
+#include "ir.h"
+
+#include <vector>
+
+namespace ir {
+
+/*!
+    Where a value is live, as one range of positions: instructions are
+    numbered in block order, two apart, and a value live out of a block
+    is live one past the block's terminator, where the copies into the
+    phis of the next block happen.
+*/
+struct LiveInterval {
+    Value value;
+    qint32 start;           // position of the definition, of the block for a phi
+    qint32 end;             // last position the value is needed at
+    float weight = 0;       // uses, ten times heavier per loop level, per position
+    qint8 reg = -1;         // register index, -1 if the value stays in memory
+};
+
+/*!
+    Linear-scan register allocation (Poletto and Sarkar) over the live
+    intervals of the values of a function. Intervals are visited by
+    start; one that finds every register taken either stays in memory
+    or takes the register of an active interval that weighs less, which
+    then stays in memory for its whole life. Uses in loops weigh more, so
+    the variables of a hot loop keep their registers and what is left
+    over is spilled.
+
+    Values the code generator folds into the expression of their user
+    get no interval: their operands are used where the whole expression
+    is. Constants need none either. Liveness is found per value by
+    walking up from every use to the definition, which SSA makes exact
+    and cheap; a value live into a loop header is live out of the latch,
+    so its interval covers the whole loop.
+*/
+class LinearScan {
+    const Function* __function;
+    int __registers;
+
+    std::vector<qint32> __position;         // of every instruction
+    std::vector<qint32> __block_start;
+    std::vector<qint32> __block_end;        // position of the terminator
+    std::vector<qint32> __depth;            // loop nesting of every block
+    std::vector<qint32> __interval;         // index in __intervals, -1 if none
+    std::vector<LiveInterval> __intervals;  // by start
+    std::vector<quint32> __live_through;    // registers of values live past an instruction
+    std::vector<quint32> __live_at;         // and of the values it reads last
+    qsizetype __spilled = 0;
+
+    void number();
+    void buildIntervals(const std::vector<char>& folded);
+    void allocate();
+    void findLiveRegisters();
+
+public:
+    LinearScan(const Function* function, int registers)
+        : __function(function), __registers(registers) {}
+
+    //! folded has a non-zero entry for every value evaluated inside its user.
+    void run(const std::vector<char>& folded);
+
+    //! Register index of the value, -1 if it lives in memory or needs no place.
+    int register_of(Value value) const {
+        return __interval[value] < 0 ? -1 : __intervals[__interval[value]].reg;
+    }
+
+    /*!
+        Bit per register index holding a value defined before the
+        instruction that is still needed after it.
+    */
+    quint32 live_through(Value instruction) const { return __live_through[instruction]; }
+    //! live_through() and the registers of the operands the instruction reads last.
+    quint32 live_at(Value instruction) const { return __live_at[instruction]; }
+
+    qsizetype intervals() const { return (qsizetype)__intervals.size(); }
+    //! Intervals that found no register.
+    qsizetype spilled() const { return __spilled; }
+};
+
+} // namespace ir
+
+#endif // REGALLOC_H
@@ -0,0 +1,188 @@
+#include "scan.h"
+
+#include <QChar>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__)
+#define SCAN_X86 1
+#include <immintrin.h>
+#endif
+
+namespace scan {
+
+namespace {
+
+inline bool is_space(quint8 c) {
+    return c == ' ' || c == '\n' || c == '\t' || c == '\r' || c == '\0';
+}
+
+inline bool is_alnum(quint8 c) {
+    return (c >= '0' && c <= '9') || ((c | 0x20) >= 'a' && (c | 0x20) <= 'z');
+}
+
+const char* skip_whitespace_scalar(const char* p, const char* end) {
+    while (p != end && is_space(*p))
+        p++;
+    return p;
+}
+
+const char* skip_alnum_scalar(const char* p, const char* end) {
+    while (p != end && is_alnum(*p))
+        p++;
+    return p;
+}
+
+#ifdef SCAN_X86
+
+inline unsigned trailing_zeros(quint32 mask) {
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return index;
+#else
+    return __builtin_ctz(mask);
+#endif
+}
+
+inline __m128i in_range_sse2(__m128i x, char lo, char hi) {
+    __m128i ge = _mm_cmpeq_epi8(_mm_max_epu8(x, _mm_set1_epi8(lo)), x);
+    __m128i le = _mm_cmpeq_epi8(_mm_min_epu8(x, _mm_set1_epi8(hi)), x);
+    return _mm_and_si128(ge, le);
+}
+
+const char* skip_whitespace_sse2(const char* p, const char* end) {
+    for (; end - p >= 16; p += 16) {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        __m128i ws = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(x, _mm_set1_epi8(' ')),
+                         _mm_cmpeq_epi8(x, _mm_set1_epi8('\n'))),
+            _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(x, _mm_set1_epi8('\t')),
+                                      _mm_cmpeq_epi8(x, _mm_set1_epi8('\r'))),
+                         _mm_cmpeq_epi8(x, _mm_setzero_si128())));
+
+        quint32 stop = ~(quint32)_mm_movemask_epi8(ws) & 0xFFFF;
+        if (stop)
+            return p + trailing_zeros(stop);
+    }
+    return skip_whitespace_scalar(p, end);
+}
+
+const char* skip_alnum_sse2(const char* p, const char* end) {
+    for (; end - p >= 16; p += 16) {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        __m128i lower = _mm_or_si128(x, _mm_set1_epi8(0x20));
+        __m128i alnum = _mm_or_si128(in_range_sse2(x, '0', '9'),
+                                     in_range_sse2(lower, 'a', 'z'));
+
+        quint32 stop = ~(quint32)_mm_movemask_epi8(alnum) & 0xFFFF;
+        if (stop)
+            return p + trailing_zeros(stop);
+    }
+    return skip_alnum_scalar(p, end);
+}
+
+#endif // SCAN_X86
+
+using Kernel = const char* (*)(const char*, const char*);
+
+struct Kernels {
+    Kernel whitespace;
+    Kernel alnum;
+};
+
+Kernels kernels_for(Isa isa) {
+    switch (isa) {
+#ifdef SCAN_X86
+    case Isa::SSE2:
+        return {skip_whitespace_sse2, skip_alnum_sse2};
+#endif
+    default:
+        return {skip_whitespace_scalar, skip_alnum_scalar};
+    }
+}
+
+const Kernels kernels = kernels_for(has_isa(Isa::SSE2) ? Isa::SSE2 : Isa::Scalar);
+
+} // namespace
+
+bool has_isa(Isa isa) {
+    switch (isa) {
+    case Isa::Scalar:
+        return true;
+    case Isa::SSE2:
+#ifdef SCAN_X86
+        return true;
+#else
+        return false;
+#endif
+    }
+    return false;
+}
+
+const char* skip_whitespace(Isa isa, const char* p, const char* end) {
+    return kernels_for(isa).whitespace(p, end);
+}
+
+const char* skip_alnum(Isa isa, const char* p, const char* end) {
+    return kernels_for(isa).alnum(p, end);
+}
+
+const char* skip_whitespace(const char* p, const char* end) {
+    return kernels.whitespace(p, end);
+}
+
+const char* skip_word(const char* p, const char* end) {
+    for (;;) {
+        p = kernels.alnum(p, end);
+
+        if (p == end || (quint8)*p < 0x80)
+            return p;
+
+        qsizetype width = utf8_word_char(p, end);
+        if (width == 0)
+            return p;
+        p += width;
+    }
+}
+
+/*!
+    Decodes one UTF-8 sequence and tests it the way the old QChar loop did:
+    isDigit() or isLetter(). Characters outside the BMP and malformed
+    sequences are not word characters.
+*/
+qsizetype utf8_word_char(const char* p, const char* end) {
+    const quint8 lead = *p;
+    char32_t code;
+    qsizetype width;
+
+    if (lead < 0x80)
+        return is_alnum(lead) ? 1 : 0;
+    else if ((lead & 0xE0) == 0xC0) {
+        code = lead & 0x1F;
+        width = 2;
+    }
+    else if ((lead & 0xF0) == 0xE0) {
+        code = lead & 0x0F;
+        width = 3;
+    }
+    else
+        return 0;
+
+    if (end - p < width)
+        return 0;
+
+    for (qsizetype i = 1; i < width; i++) {
+        const quint8 c = p[i];
+        if ((c & 0xC0) != 0x80)
+            return 0;
+        code = (code << 6) | (c & 0x3F);
+    }
+
+    if ((width == 2 && code < 0x80) || (width == 3 && code < 0x800) ||
+        (code >= 0xD800 && code <= 0xDFFF))
+        return 0;
+
+    const QChar ch((char16_t)code);
+    return ch.isDigit() || ch.isLetter() ? width : 0;
+}
+
+} // namespace scan
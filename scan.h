@@ -0,0 +1,40 @@
+#ifndef SCAN_H
+#define SCAN_H
+
+#include <QtGlobal>
+
+/*!
+    Run-skipping kernels used by the lexer.
+    Each function returns the first byte in [p, end) that does not belong
+    to the run. ASCII is checked 16 bytes at a time with SSE2; non-ASCII
+    bytes drop to a scalar UTF-8 slow path. An AVX2 kernel only pulled
+    ahead on runs of hundreds of bytes, which sources do not have (see
+    bench/scan_bench.cpp), so there is none.
+*/
+namespace scan {
+
+//! Skips ' ', '\n', '\t', '\r' and '\0'.
+const char* skip_whitespace(const char* p, const char* end);
+
+//! Skips letters and digits, including non-ASCII ones.
+const char* skip_word(const char* p, const char* end);
+
+//! Length of the UTF-8 letter or digit at p, 0 if there is none.
+qsizetype utf8_word_char(const char* p, const char* end);
+
+//! The instruction sets there are kernels for.
+enum class Isa { Scalar, SSE2 };
+
+//! Whether this build and CPU can run the kernels for isa.
+bool has_isa(Isa isa);
+
+/*!
+    The kernels for one instruction set, ASCII only, for the benchmark
+    that compares them. isa must be one has_isa() accepts.
+*/
+const char* skip_whitespace(Isa isa, const char* p, const char* end);
+const char* skip_alnum(Isa isa, const char* p, const char* end);
+
+} // namespace scan
+
+#endif // SCAN_H
@@ -1,85 +1,181 @@
 #include "sema.h"
 #include <QDebug>
 
-SemanticAnalyzer::SemanticAnalyzer() {
-    declared_variables.clear();
-    semantic_errors.clear();
+#include <algorithm>
+
+namespace {
+
+constexpr quint8 begin_symbol = grammar::symbol("begin");
+
+} // namespace
+
+/*!
+    What each RuleType does with the ids it covers, indexed by RuleType.
+    Atoms and lists of them can still turn out to be declarations, so
+    their reductions leave the ids pending and have no handler.
+*/
+const SemanticAnalyzer::Handler SemanticAnalyzer::handlers[] = {
+    &SemanticAnalyzer::onProgram,       // PROGRAM
+    &SemanticAnalyzer::onDeclaration,   // VAR
+    nullptr,                            // ID
+    &SemanticAnalyzer::onUse,           // EXPR
+    &SemanticAnalyzer::onUse,           // OUT
+    &SemanticAnalyzer::onUse,           // IN
+    &SemanticAnalyzer::onUse,           // IF
+    &SemanticAnalyzer::onUse,           // IF_ELSE
+    &SemanticAnalyzer::onUse,           // FOR
+    &SemanticAnalyzer::onUse,           // WHILE
+    &SemanticAnalyzer::onUse,           // LET
+    &SemanticAnalyzer::onBlock,         // BLOCK
+    nullptr,                            // E
+    &SemanticAnalyzer::onUse,           // NEG
+};
+
+void SemanticAnalyzer::reset(const Lexer* source_lexer) {
+    lexer = source_lexer;
+    variables.clear();
+    variables.reserve(lexer->get_ids().size());
+    pending.clear();
+    errors.clear();
+    declarations = 0;
 }
 
-bool SemanticAnalyzer::analyze(const QList<QPair<QString, QList<Lexema>>>& conv_sequence) {
-    semantic_errors.clear();
-
-    try {
-        for (const auto& [rule_name, operands] : conv_sequence) {
-            // Find the rule type
-            RuleType rule_type = RuleType::PROGRAM;
-            for (const auto& rule : rules) {
-                if (rule.name() == rule_name) {
-                    rule_type = rule.type();
-                    break;
-                }
-            }
-
-            // Process variable declarations
-            if (rule_type == RuleType::VAR) {
-                processVariableDeclaration(operands);
-            }
-
-            // Process variable usage in assignments, expressions, etc.
-            else if (rule_type == RuleType::EXPR ||
-                     rule_type == RuleType::IN || rule_type == RuleType::OUT ||
-                     rule_type == RuleType::FOR || rule_type == RuleType::WHILE ||
-                     rule_type == RuleType::IF) {
-                processIdentifierUsage(operands);
-            }
-        }
+void SemanticAnalyzer::shift(const Lexema& lex, qint32 token) {
+    if (lex.type() == TokenType::Id)
+        pending.push_back({lex.symbol(), token, lex.offset()});
+    else if (lex.grammar() == begin_symbol)
+        variables.enter_scope();
+}
 
-        return semantic_errors.isEmpty();
+void SemanticAnalyzer::reduce(RuleType type, qint32 first, qint32 last) {
+    static_assert(std::size(handlers) == (std::size_t)RuleType::NEG + 1,
+                  "a handler for every RuleType");
+    if (Handler handler = handlers[(int)type])
+        (this->*handler)(first, last);
+}
 
-    } catch (const std::exception& e) {
-        semantic_errors.append(QString("Analysis error: %1").arg(e.what()));
-        return false;
-    }
+/*!
+    Reductions take the top of the stack, so the ids a rule covers are
+    always the tail of pending. Returns where that tail starts.
+*/
+qsizetype SemanticAnalyzer::pendingFrom(qint32 first) const {
+    qsizetype from = pending.size();
+    while (from > 0 && pending.at(from - 1).token >= first)
+        from--;
+    return from;
 }
 
-void SemanticAnalyzer::processVariableDeclaration(const QList<Lexema>& operands) {
-    // Extract variable names from VAR declaration
-    for (const auto& lex : operands) {
-        if (lex.type() == TokenType::Id) {
-            QString var_name = lex.const_name();
-            if (declared_variables.contains(var_name)) {
-                semantic_errors.append(QString("Variable '%1' is already declared").arg(var_name));
-            } else {
-                declared_variables.insert(var_name);
-                current_scope_vars.insert(var_name);
-            }
-        }
+/*!
+    The program's own name is the id right after "program"; it names no
+    variable.
+*/
+void SemanticAnalyzer::onProgram(qint32 first, qint32) {
+    qsizetype from = pendingFrom(first);
+    if (from < pending.size() && pending.at(from).token == first + 1)
+        pending.remove(from);
+    checkUses(from);
+    variables.leave_scope();
+}
+
+void SemanticAnalyzer::onDeclaration(qint32 first, qint32) {
+    qsizetype from = pendingFrom(first);
+
+    for (qsizetype i = from; i < pending.size(); i++) {
+        const PendingId& id = pending.at(i);
+        if (!variables.declare(id.symbol))
+            addError(id, QString("Variable '%1' is already declared")
+                             .arg(lexer->get_ids().value(id.symbol)));
     }
+
+    pending.resize(from);
+    declarations++;
+}
+
+void SemanticAnalyzer::onBlock(qint32 first, qint32) {
+    checkUses(pendingFrom(first));
+    variables.leave_scope();
+}
+
+void SemanticAnalyzer::onUse(qint32 first, qint32) {
+    checkUses(pendingFrom(first));
+}
+
+void SemanticAnalyzer::checkUses(qsizetype from) {
+    for (qsizetype i = from; i < pending.size(); i++)
+        if (!variables.contains(pending.at(i).symbol))
+            addError(pending.at(i), QString("Variable '%1' is used before declaration")
+                                        .arg(lexer->get_ids().value(pending.at(i).symbol)));
+    pending.resize(from);
+}
+
+/*!
+    Ids nothing claimed, like a bare id as the whole body, are uses.
+    Errors are kept in source order.
+*/
+void SemanticAnalyzer::finish() {
+    checkUses(0);
+    std::stable_sort(errors.begin(), errors.end(), [](const Error& a, const Error& b) {
+        return a.token < b.token;
+    });
 }
 
-void SemanticAnalyzer::processIdentifierUsage(const QList<Lexema>& operands) {
-    // Check all identifiers in the operands
-    for (const auto& lex : operands) {
-        if (lex.type() == TokenType::Id) {
-            checkVariableDeclaration(lex.const_name());
+void SemanticAnalyzer::startReparse() {
+    pending.clear();
+}
+
+/*!
+    After the tokens from first on were reparsed: drops the errors of the
+    removed tokens, moves the ones after them to their new tokens and
+    merges in the errors found by the reparse, which were added after
+    kept_errors.
+*/
+void SemanticAnalyzer::splice(qint32 first, qint32 removed, qint32 added, qsizetype kept_errors) {
+    checkUses(0);
+
+    const TokenStore& tokens = lexer->get_tokenized_code();
+    QList<Error> merged;
+    merged.reserve(errors.size());
+
+    for (qsizetype i = 0; i < kept_errors; i++) {
+        Error error = errors.at(i);
+        if (error.token >= first + removed) {
+            error.token += added - removed;
+            error.diagnostic.offset = tokens.at(error.token).offset();
         }
+        else if (error.token >= first)
+            continue;
+        merged.push_back(error);
     }
+    for (qsizetype i = kept_errors; i < errors.size(); i++)
+        merged.push_back(errors.at(i));
+
+    std::stable_sort(merged.begin(), merged.end(), [](const Error& a, const Error& b) {
+        return a.token < b.token;
+    });
+    errors.swap(merged);
 }
 
-void SemanticAnalyzer::checkVariableDeclaration(const QString& var_name) {
-    if (!declared_variables.contains(var_name)) {
-        semantic_errors.append(QString("Variable '%1' is used before declaration").arg(var_name));
-    }
+void SemanticAnalyzer::addError(const PendingId& at, const QString& message) {
+    errors.push_back({at.token, {at.offset, (quint32)lexer->get_ids().text(at.symbol).size(),
+                                 message}});
+}
+
+QList<QString> SemanticAnalyzer::getErrors() const {
+    QList<QString> messages;
+    for (const Error& error : errors)
+        messages.append(QString("%1: %2").arg(lexer->get_source()->location(error.diagnostic.offset),
+                                              error.diagnostic.message));
+    return messages;
 }
 
 void SemanticAnalyzer::printErrors() const {
-    if (semantic_errors.isEmpty()) {
+    if (errors.isEmpty()) {
         qDebug() << "No semantic errors found. All variables are properly declared.";
         return;
     }
 
     qDebug() << "=== VARIABLE DECLARATION ERRORS ===";
-    for (const auto& error : semantic_errors) {
+    for (const auto& error : getErrors()) {
         qDebug() << "ERROR:" << error;
     }
 }
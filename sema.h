@@ -1,38 +1,84 @@
 #ifndef SEMANTIC_ANALYZER_H
 #define SEMANTIC_ANALYZER_H
 
-#include <QSet>
 #include <QString>
 #include <QList>
-#include <QPair>
+
+#include "diagnostics.h"
 #include "lexer.h"
 #include "parser_rules.h"
+#include "variables.h"
 
+/*!
+    Checks that every variable is declared once and before it is used.
+    Runs inside the parser: shift() hands it every id as it is shifted and
+    reduce() every rule as it is reduced, dispatched on the RuleType of
+    the rule. Ids stay pending until a rule claims them: the declaration
+    rule declares them, list rules leave them to the rule around them and
+    every other rule checks them as uses. Variables are the symbol ids the
+    lexer interned them under, so no name is ever compared. Every "begin"
+    opens a scope of the variable table, which the code generator reuses
+    to lay the variables out.
+*/
 class SemanticAnalyzer {
 private:
-    QSet<QString> declared_variables;
-    QList<QString> semantic_errors;
+    struct PendingId {
+        qint32 symbol;
+        qint32 token;
+        quint32 offset;
+    };
+
+    struct Error {
+        qint32 token;
+        Diagnostic diagnostic;
+    };
+
+    using Handler = void (SemanticAnalyzer::*)(qint32 first, qint32 last);
+
+    static const Handler handlers[];
+
+    const Lexer* lexer = nullptr;
 
-    // Track variables declared in current scope
-    QSet<QString> current_scope_vars;
+    VariableTable variables;
+    QList<PendingId> pending;
+    QList<Error> errors;
+    qsizetype declarations = 0;
 
-    void processVariableDeclaration(const QList<Lexema>& operands);
-    void processIdentifierUsage(const QList<Lexema>& operands);
-    void checkVariableDeclaration(const QString& var_name);
+    qsizetype pendingFrom(qint32 first) const;
+
+    void onProgram(qint32 first, qint32 last);
+    void onDeclaration(qint32 first, qint32 last);
+    void onBlock(qint32 first, qint32 last);
+    void onUse(qint32 first, qint32 last);
+
+    void checkUses(qsizetype from);
+    void addError(const PendingId& at, const QString& message);
 
 public:
-    SemanticAnalyzer();
+    SemanticAnalyzer() {}
+
+    // Starts over for the source the lexer holds
+    void reset(const Lexer* source_lexer);
+
+    void shift(const Lexema& lex, qint32 token);
+    void reduce(RuleType type, qint32 first, qint32 last);
+    void finish();
 
-    // Main analysis method - only checks variable declaration before use
-    bool analyze(const QList<QPair<QString, QList<Lexema>>>& conv_sequence);
+    // Incremental reparse: the reparsed tokens are checked against the
+    // declarations kept from the last full parse
+    void startReparse();
+    void splice(qint32 first, qint32 removed, qint32 added, qsizetype kept_errors);
+    qsizetype errorCount() const { return errors.size(); }
+    qsizetype declarationCount() const { return declarations; }
 
     // Utility methods
     void printErrors() const;
 
     // Getters
-    bool hasErrors() const { return !semantic_errors.isEmpty(); }
-    const QList<QString>& getErrors() const { return semantic_errors; }
-    const QSet<QString>& getDeclaredVariables() const { return declared_variables; }
+    bool hasErrors() const { return !errors.isEmpty(); }
+    VariableTable& getVariables() { return variables; }
+    const VariableTable& getVariables() const { return variables; }
+    QList<QString> getErrors() const;
 };
 
 #endif // SEMANTIC_ANALYZER_H
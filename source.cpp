@@ -0,0 +1,85 @@
+#include "source.h"
+
+#include <algorithm>
+#include <cstring>
+
+/*!
+    Maps the file into memory.
+    Falls back to reading it whole if the platform refuses the mapping.
+    Returns a null pointer if the file cannot be opened.
+*/
+QSharedPointer<const SourceBuffer> SourceBuffer::fromFile(const QString& filename) {
+    QSharedPointer<SourceBuffer> buffer(new SourceBuffer);
+
+    buffer->__filename = filename;
+    buffer->__file.setFileName(filename);
+    if (!buffer->__file.open(QIODeviceBase::ReadOnly))
+        return {};
+
+    qint64 size = buffer->__file.size();
+    if (size == 0)
+        return buffer;
+
+    if (uchar* mapped = buffer->__file.map(0, size)) {
+        buffer->__data = reinterpret_cast<const char*>(mapped);
+        buffer->__size = size;
+    }
+    else {
+        buffer->__text = buffer->__file.readAll();
+        buffer->__data = buffer->__text.constData();
+        buffer->__size = buffer->__text.size();
+    }
+
+    return buffer;
+}
+
+/*!
+    Keeps a UTF-8 copy of the editor text.
+*/
+QSharedPointer<const SourceBuffer> SourceBuffer::fromText(const QString& text) {
+    QSharedPointer<SourceBuffer> buffer(new SourceBuffer);
+
+    buffer->__text = text.toUtf8();
+    buffer->__data = buffer->__text.constData();
+    buffer->__size = buffer->__text.size();
+
+    return buffer;
+}
+
+/*!
+    Records the offset of every line start, once.
+*/
+void SourceBuffer::build_line_index() const {
+    std::call_once(__lines_built, [this]() {
+        __line_starts.push_back(0);
+
+        const char* p = __data;
+        const char* end = __data + __size;
+        while (const void* nl = memchr(p, '\n', end - p)) {
+            p = static_cast<const char*>(nl) + 1;
+            __line_starts.push_back((quint32)(p - __data));
+        }
+    });
+}
+
+SourceBuffer::Position SourceBuffer::position(qsizetype offset) const {
+    build_line_index();
+
+    offset = qBound((qsizetype)0, offset, __size);
+    auto line = std::upper_bound(__line_starts.cbegin(), __line_starts.cend(), (quint32)offset) - 1;
+
+    qsizetype column = 1;
+    for (const char* p = __data + *line; p < __data + offset; p++)
+        if ((*p & 0xC0) != 0x80)
+            column++;
+
+    return {line - __line_starts.cbegin() + 1, column};
+}
+
+/*!
+    Returns "name:line:col" for a byte offset.
+*/
+QString SourceBuffer::location(qsizetype offset) const {
+    Position pos = position(offset);
+    return QString("%1:%2:%3").arg(name()).arg(pos.line).arg(pos.column);
+}
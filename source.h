@@ -0,0 +1,67 @@
+#ifndef SOURCE_H
+#define SOURCE_H
+
+#include <QFile>
+#include <QString>
+#include <QByteArray>
+#include <QByteArrayView>
+#include <QSharedPointer>
+#include <QList>
+
+#include <mutex>
+
+/*!
+    Read-only source text shared by the editor, the lexer and every token.
+    Files are memory-mapped (mmap on Linux), so loading a file costs no
+    copy of its contents; tokens refer to it by offset and length.
+*/
+class SourceBuffer {
+    QString __filename;
+    QFile __file;
+    QByteArray __text;
+    const char* __data = "";
+    qsizetype __size = 0;
+
+    mutable std::once_flag __lines_built;
+    mutable QList<quint32> __line_starts;
+
+    SourceBuffer() = default;
+
+    void build_line_index() const;
+
+public:
+    Q_DISABLE_COPY_MOVE(SourceBuffer)
+
+    static QSharedPointer<const SourceBuffer> fromFile(const QString& filename);
+    static QSharedPointer<const SourceBuffer> fromText(const QString& text);
+
+    bool is_file() const { return !__filename.isEmpty(); }
+    QString filename() const { return __filename; }
+
+    const char* data() const { return __data; }
+    qsizetype size() const { return __size; }
+
+    QByteArrayView view(qsizetype offset, qsizetype length) const {
+        return QByteArrayView(__data + offset, length);
+    }
+    qsizetype offset_of(const char* ptr) const { return ptr - __data; }
+
+    QString toQString() const { return QString::fromUtf8(__data, __size); }
+
+    //! Name to show in diagnostics.
+    QString name() const { return is_file() ? __filename : QString("<text>"); }
+
+    /*!
+        1-based line and column (in characters) of a byte offset.
+        Line starts are indexed the first time a position is asked for,
+        so lexing never pays for line counting.
+    */
+    struct Position {
+        qsizetype line;
+        qsizetype column;
+    };
+    Position position(qsizetype offset) const;
+    QString location(qsizetype offset) const;
+};
+
+#endif // SOURCE_H
@@ -0,0 +1,101 @@
+#include "symbols.h"
+
+#include <cstring>
+
+/*!
+    Returns the id of text, adding it to the table if it is new.
+*/
+qint32 SymbolTable::intern(QByteArrayView text) {
+    if ((qsizetype)__texts.size() * 2 >= (qsizetype)__slots.size())
+        grow();
+
+    const quint32 h = hash(text);
+    const size_t mask = __slots.size() - 1;
+
+    for (size_t i = h & mask;; i = (i + 1) & mask) {
+        Slot& slot = __slots[i];
+
+        if (slot.id < 0) {
+            slot.hash = h;
+            slot.id = (qint32)__texts.size();
+            __texts.push_back(store(text));
+            return slot.id;
+        }
+
+        if (slot.hash == h && __texts[slot.id] == text)
+            return slot.id;
+    }
+}
+
+/*!
+    Returns the id of text, or -1 if it was never interned.
+*/
+qint32 SymbolTable::find(QByteArrayView text) const {
+    if (__slots.empty())
+        return -1;
+
+    const quint32 h = hash(text);
+    const size_t mask = __slots.size() - 1;
+
+    for (size_t i = h & mask;; i = (i + 1) & mask) {
+        const Slot& slot = __slots[i];
+
+        if (slot.id < 0)
+            return -1;
+
+        if (slot.hash == h && __texts[slot.id] == text)
+            return slot.id;
+    }
+}
+
+/*!
+    Doubles the slot array and reinserts every id by its stored hash.
+*/
+void SymbolTable::grow() {
+    std::vector<Slot> slots(__slots.empty() ? 64 : __slots.size() * 2);
+    const size_t mask = slots.size() - 1;
+
+    for (const Slot& slot : __slots) {
+        if (slot.id < 0)
+            continue;
+
+        size_t i = slot.hash & mask;
+        while (slots[i].id >= 0)
+            i = (i + 1) & mask;
+        slots[i] = slot;
+    }
+
+    __slots.swap(slots);
+}
+
+/*!
+    Copies text into the current block, starting a new one when it is full.
+    Texts longer than a block get a block of their own.
+*/
+QByteArrayView SymbolTable::store(QByteArrayView text) {
+    if (text.size() > block_size) {
+        __blocks.emplace_back(new char[text.size()]);
+        std::memcpy(__blocks.back().get(), text.data(), text.size());
+        return QByteArrayView(__blocks.back().get(), text.size());
+    }
+
+    if (__block_used + text.size() > block_size) {
+        __blocks.emplace_back(new char[block_size]);
+        __block = __blocks.back().get();
+        __block_used = 0;
+    }
+
+    char* dest = __block + __block_used;
+    std::memcpy(dest, text.data(), text.size());
+    __block_used += text.size();
+
+    return QByteArrayView(dest, text.size());
+}
+
+void SymbolTable::clear() {
+    __slots.clear();
+    __texts.clear();
+    __blocks.clear();
+    __block = nullptr;
+    __block_used = block_size;
+}
@@ -0,0 +1,54 @@
+#ifndef SYMBOLS_H
+#define SYMBOLS_H
+
+#include <QString>
+#include <QByteArrayView>
+
+#include <memory>
+#include <vector>
+
+/*!
+    Interns token texts.
+    Every distinct text gets a dense symbol id (0, 1, 2, ...) in the order
+    it was first seen. Lookup is an open-addressing hash with linear
+    probing; the texts themselves are copied into fixed-size blocks that
+    never move, so views returned by text() stay valid until clear().
+*/
+class SymbolTable {
+    struct Slot {
+        quint32 hash = 0;
+        qint32 id = -1;
+    };
+
+    static constexpr qsizetype block_size = 64 * 1024;
+
+    std::vector<Slot> __slots;
+    std::vector<QByteArrayView> __texts;
+    std::vector<std::unique_ptr<char[]>> __blocks;
+    char* __block = nullptr;
+    qsizetype __block_used = block_size;
+
+    void grow();
+    QByteArrayView store(QByteArrayView text);
+
+public:
+    SymbolTable() = default;
+
+    static quint32 hash(QByteArrayView text) {
+        quint32 h = 2166136261u;
+        for (char c : text)
+            h = (h ^ (quint8)c) * 16777619u;
+        return h;
+    }
+
+    qint32 intern(QByteArrayView text);
+    qint32 find(QByteArrayView text) const;
+
+    QByteArrayView text(qint32 id) const { return __texts[id]; }
+    QString value(qint32 id) const { return QString::fromUtf8(__texts[id]); }
+    qsizetype size() const { return (qsizetype)__texts.size(); }
+
+    void clear();
+};
+
+#endif // SYMBOLS_H
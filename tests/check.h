@@ -0,0 +1,31 @@
+#ifndef CHECK_H
+#define CHECK_H
+
+#include <cstdio>
+
+/*!
+    The little the tests need: CHECK reports a failed condition with its
+    location and keeps going, check_result() turns the failures into the
+    exit code ctest reads.
+*/
+namespace check {
+
+inline int failures = 0;
+
+inline void fail(const char* file, int line, const char* condition) {
+    std::fprintf(stderr, "%s:%d: CHECK(%s) failed\n", file, line, condition);
+    failures++;
+}
+
+inline int check_result() {
+    if (failures)
+        std::fprintf(stderr, "%d check(s) failed\n", failures);
+    return failures ? 1 : 0;
+}
+
+} // namespace check
+
+#define CHECK(condition) \
+    ((condition) ? (void)0 : check::fail(__FILE__, __LINE__, #condition))
+
+#endif // CHECK_H
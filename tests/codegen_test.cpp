@@ -0,0 +1,112 @@
+#include "check.h"
+#include "x86sim.h"
+
+#include "irbuilder.h"
+#include "lexer.h"
+#include "parser.h"
+#include "passes.h"
+#include "translation.h"
+
+#include <QByteArray>
+#include <QFile>
+#include <QString>
+
+#include <cstdio>
+#include <stdexcept>
+
+/*!
+    Compiles the programs in tests/programs, runs the code on X86Sim and
+    checks what it prints against <name>.expected, with <name>.in as its
+    input; the listings are written to the build directory. Each program
+    also has to make the allocator spill and the builder place phis at
+    least as often as the table says, so that a change which stops
+    exercising them shows up here too.
+
+    The steps and memory accesses of each run are printed as well: they
+    are what the code generation benchmarks compare.
+*/
+
+namespace {
+
+struct Program {
+    const char* name;
+    qsizetype min_spilled;
+    qsizetype min_phis;     // a variable changed in a loop needs one at its head
+};
+
+/*!
+    spills keeps eight variables alive around its loop, twice the
+    registers the allocator has, and swaps two of them on every turn.
+*/
+const Program programs[] = {
+    {"sum_squares", 0, 2},
+    {"gcd", 0, 4},
+    {"fibonacci", 0, 3},
+    {"nested_loops", 0, 6},
+    {"spills", 4, 8},
+    {"for_input", 0, 3},
+};
+
+QByteArray read_file(const QString& filename) {
+    QFile file(filename);
+    if (!file.open(QIODevice::ReadOnly))
+        return QByteArray();
+    return file.readAll();
+}
+
+qsizetype phi_count(const ir::Function& function) {
+    qsizetype phis = 0;
+    for (ir::Block block = 0; block < function.block_count(); block++)
+        for (ir::Value value : function.block(block).instructions)
+            phis += function.at(value).op == ir::Opcode::Phi;
+    return phis;
+}
+
+void run(const Program& program) {
+    const QString path = QString("%1/%2").arg(DSL_TEST_PROGRAMS, program.name);
+
+    Lexer lexer;
+    CHECK(lexer.loadFile(path + ".dsl"));
+    CHECK(lexer.analyze());
+
+    Parser parser(&lexer);
+    CHECK(parser.analyze());
+    CHECK(!parser.hasSemanticErrors());
+
+    ir::Function function;
+    ir::Builder(&lexer, &parser.ast()).build(function);
+    ir::PassManager::standard().run(function);
+    CHECK(ir::verify(function).isEmpty());
+
+    AsmGenerator asmgen(&lexer, &function, &parser.variables());
+    CHECK(asmgen.generate(QString("%1/%2.asm").arg(DSL_TEST_OUTPUT, program.name)));
+
+    X86Sim sim(asmgen.code());
+    try {
+        sim.run(read_file(path + ".in"));
+    } catch (const std::runtime_error& error) {
+        std::fprintf(stderr, "%s: %s\n", program.name, error.what());
+        CHECK(false);
+    }
+
+    const qsizetype spilled = asmgen.allocation().spilled();
+    const qsizetype phis = phi_count(function);
+    const bool printed = sim.output() == read_file(path + ".expected");
+    CHECK(printed);
+    CHECK(spilled >= program.min_spilled);
+    CHECK(phis >= program.min_phis);
+    if (!printed)
+        std::fprintf(stderr, "%s printed:\n%s", program.name, sim.output().constData());
+
+    std::printf("%-14s %10lld %10lld %8lld %6lld\n", program.name, (long long)sim.steps(),
+                (long long)sim.memory_accesses(), (long long)spilled, (long long)phis);
+}
+
+} // namespace
+
+int main() {
+    std::printf("%-14s %10s %10s %8s %6s\n", "program", "steps", "memory", "spilled", "phis");
+    for (const Program& program : programs)
+        run(program);
+    return check::check_result();
+}
@@ -0,0 +1,121 @@
+#include "check.h"
+#include "lexer.h"
+#include "parser.h"
+#include "source.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+/*!
+    Parsing a known number of tokens must not allocate once the parser
+    has sized its stack, its arena and its tables. Every operator new and
+    (with glibc) every malloc, calloc and realloc is counted while a
+    parser that already parsed the program parses it again.
+*/
+
+namespace {
+
+std::atomic<bool> counting {false};
+std::atomic<long> allocations {0};
+
+void count() {
+    if (counting.load(std::memory_order_relaxed))
+        allocations.fetch_add(1, std::memory_order_relaxed);
+}
+
+} // namespace
+
+#if defined(__GLIBC__)
+extern "C" {
+void* __libc_malloc(std::size_t size);
+void* __libc_calloc(std::size_t count, std::size_t size);
+void* __libc_realloc(void* pointer, std::size_t size);
+
+// Qt containers allocate with malloc, not with operator new
+void* malloc(std::size_t size) { count(); return __libc_malloc(size); }
+void* calloc(std::size_t count_, std::size_t size) { count(); return __libc_calloc(count_, size); }
+void* realloc(void* pointer, std::size_t size) { count(); return __libc_realloc(pointer, size); }
+}
+
+static void* raw_malloc(std::size_t size) { return __libc_malloc(size); }
+#else
+static void* raw_malloc(std::size_t size) { return std::malloc(size); }
+#endif
+
+void* operator new(std::size_t size) {
+    count();
+    if (void* pointer = raw_malloc(size ? size : 1))
+        return pointer;
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size) { return operator new(size); }
+void operator delete(void* pointer) noexcept { std::free(pointer); }
+void operator delete[](void* pointer) noexcept { std::free(pointer); }
+void operator delete(void* pointer, std::size_t) noexcept { std::free(pointer); }
+void operator delete[](void* pointer, std::size_t) noexcept { std::free(pointer); }
+
+namespace {
+
+const char* const program = R"(program p0p
+var a0a, b0b, t0t, k0k, r0r, n0n int
+begin
+  input(n0n);
+  let r0r = 0;
+  let k0k = n0n;
+  for (k0k; k0k; 1) begin
+    let a0a = k0k * 37 + 11;
+    let b0b = (k0k * 13 + 5) / 2;
+    while (b0b) begin
+      let t0t = a0a - (a0a / b0b) * b0b;
+      let a0a = b0b;
+      let b0b = t0t
+    end;
+    if (a0a - 1) then let r0r = r0r + a0a else let r0r = r0r + 1;
+    let k0k = k0k - 1
+  end;
+  output(r0r)
+end.
+)";
+
+long allocations_of(Parser& parser, bool& parsed) {
+    allocations = 0;
+    counting = true;
+    parsed = parser.analyze();
+    counting = false;
+    return allocations;
+}
+
+} // namespace
+
+int main() {
+    Lexer lexer;
+    CHECK(lexer.loadSource(SourceBuffer::fromText(program)));
+    CHECK(lexer.analyze());
+
+    Parser parser(&lexer);
+    bool parsed = false;
+
+    // The first parse reserves the stack, the arena and the tables
+    allocations_of(parser, parsed);
+    CHECK(parsed);
+    CHECK(!parser.hasSemanticErrors());
+
+    const long steady = allocations_of(parser, parsed);
+    CHECK(parsed);
+    CHECK(parser.ast().size() > 0);
+    CHECK(steady == 0);
+    if (steady)
+        std::fprintf(stderr, "%ld allocations while parsing\n", steady);
+
+    // The counters must see an operator new, or the check above proves nothing
+    allocations = 0;
+    counting = true;
+    int* volatile probe = new int(0);
+    counting = false;
+    delete probe;
+    CHECK(allocations == 1);
+
+    return check::check_result();
+}
@@ -0,0 +1,141 @@
+#include "check.h"
+#include "peephole.h"
+
+#include <QList>
+#include <QString>
+
+#include <array>
+#include <cstdio>
+
+/*!
+    Every rule of the peephole optimizer on short listings: what comes
+    out and how often each rule counts itself, including the windows a
+    rule has to leave alone.
+*/
+
+namespace {
+
+AsmLine ins(const char* op, const char* target = "", const char* source = "") {
+    return {AsmLine::Kind::Instruction, op, target, source, QString()};
+}
+
+AsmLine label(const char* name) { return {AsmLine::Kind::Label, name, {}, {}, {}}; }
+AsmLine comment(const char* text) { return {AsmLine::Kind::Comment, text, {}, {}, {}}; }
+
+using Counts = std::array<qsizetype, PeepholeOptimizer::RULES>;
+
+struct Case {
+    const char* name;
+    QList<AsmLine> input;
+    QList<AsmLine> expected;
+    Counts counts;      // StoreLoad, DeadMove, JumpToNext, JumpChain, CompareZero
+    qsizetype removed;
+};
+
+QString listing(const QList<AsmLine>& code) {
+    QString text;
+    for (const AsmLine& line : code)
+        text += line.toString() + "\n";
+    return text;
+}
+
+const QList<Case> cases = {
+    {"store then load of the same register",
+     {ins("mov", "[x]", "eax"), ins("mov", "eax", "[x]")},
+     {ins("mov", "[x]", "eax")},
+     {1, 0, 0, 0, 0}, 1},
+    {"store then read into another instruction",
+     {ins("mov", "[x]", "eax"), ins("add", "ecx", "[x]")},
+     {ins("mov", "[x]", "eax"), ins("add", "ecx", "eax")},
+     {1, 0, 0, 0, 0}, 0},
+    {"store and load with a comment between",
+     {ins("mov", "[x]", "eax"), comment("Statement end"), ins("mov", "eax", "[x]")},
+     {ins("mov", "[x]", "eax"), comment("Statement end")},
+     {1, 0, 0, 0, 0}, 1},
+    {"store and load with a label between",
+     {ins("mov", "[x]", "eax"), label("L1"), ins("mov", "eax", "[x]")},
+     {ins("mov", "[x]", "eax"), label("L1"), ins("mov", "eax", "[x]")},
+     {0, 0, 0, 0, 0}, 0},
+    {"store then load of another address",
+     {ins("mov", "[x]", "eax"), ins("mov", "eax", "[y]")},
+     {ins("mov", "[x]", "eax"), ins("mov", "eax", "[y]")},
+     {0, 0, 0, 0, 0}, 0},
+
+    {"move to itself",
+     {ins("mov", "eax", "eax"), ins("ret")},
+     {ins("ret")},
+     {0, 1, 0, 0, 0}, 1},
+    {"move overwritten before it is read",
+     {ins("mov", "eax", "1"), ins("mov", "eax", "[y]")},
+     {ins("mov", "eax", "[y]")},
+     {0, 1, 0, 0, 0}, 1},
+    {"move read by the move that overwrites it",
+     {ins("mov", "eax", "[x]"), ins("mov", "eax", "[eax]")},
+     {ins("mov", "eax", "[x]"), ins("mov", "eax", "[eax]")},
+     {0, 0, 0, 0, 0}, 0},
+
+    {"jump to the next label",
+     {ins("jmp", "L1"), label("L1"), ins("ret")},
+     {label("L1"), ins("ret")},
+     {0, 0, 1, 0, 0}, 1},
+    {"conditional jump past another label to the next one",
+     {ins("jne", "L2"), comment("else"), label("L1"), label("L2"), ins("ret")},
+     {comment("else"), label("L1"), label("L2"), ins("ret")},
+     {0, 0, 1, 0, 0}, 1},
+    {"jump over an instruction",
+     {ins("jmp", "L1"), ins("inc", "eax"), label("L1"), ins("ret")},
+     {ins("jmp", "L1"), ins("inc", "eax"), label("L1"), ins("ret")},
+     {0, 0, 0, 0, 0}, 0},
+
+    {"jump to a jmp",
+     {ins("je", "L1"), ins("inc", "eax"), label("L1"), ins("jmp", "L2"),
+      ins("dec", "eax"), label("L2"), ins("ret")},
+     {ins("je", "L2"), ins("inc", "eax"), label("L1"), ins("jmp", "L2"),
+      ins("dec", "eax"), label("L2"), ins("ret")},
+     {0, 0, 0, 1, 0}, 0},
+    {"jump into a loop of jmps",
+     {ins("je", "L1"), ins("inc", "eax"), label("L1"), ins("jmp", "L2"),
+      ins("ret"), label("L2"), ins("jmp", "L1")},
+     {ins("je", "L1"), ins("inc", "eax"), label("L1"), ins("jmp", "L2"),
+      ins("ret"), label("L2"), ins("jmp", "L1")},
+     {0, 0, 0, 0, 0}, 0},
+
+    {"compare with zero before a jump",
+     {ins("cmp", "eax", "0"), ins("je", "L1"), ins("inc", "eax"), label("L1")},
+     {ins("test", "eax", "eax"), ins("je", "L1"), ins("inc", "eax"), label("L1")},
+     {0, 0, 0, 0, 1}, 0},
+    {"compare with zero before another flag reader",
+     {ins("cmp", "eax", "0"), ins("lahf")},
+     {ins("cmp", "eax", "0"), ins("lahf")},
+     {0, 0, 0, 0, 0}, 0},
+    {"compare with zero before a setcc",
+     {ins("cmp", "eax", "0"), ins("setl", "al")},
+     {ins("cmp", "eax", "0"), ins("setl", "al")},
+     {0, 0, 0, 0, 0}, 0},
+    {"compare memory with zero",
+     {ins("cmp", "[x]", "0"), ins("je", "L1"), ins("inc", "eax"), label("L1")},
+     {ins("cmp", "[x]", "0"), ins("je", "L1"), ins("inc", "eax"), label("L1")},
+     {0, 0, 0, 0, 0}, 0},
+};
+
+} // namespace
+
+int main() {
+    for (const Case& c : cases) {
+        QList<AsmLine> code = c.input;
+        PeepholeOptimizer optimizer;
+        const qsizetype removed = optimizer.run(code);
+
+        const QString got = listing(code), expected = listing(c.expected);
+        bool ok = got == expected && removed == c.removed && optimizer.removed() == c.removed;
+        for (int rule = 0; rule < PeepholeOptimizer::RULES; rule++)
+            ok = ok && optimizer.count(PeepholeOptimizer::Rule(rule)) == c.counts[rule];
+
+        CHECK(ok);
+        if (!ok)
+            std::fprintf(stderr, "%s:\n%s--- expected\n%s%s\n", c.name,
+                         got.toUtf8().constData(), expected.toUtf8().constData(),
+                         optimizer.report().toUtf8().constData());
+    }
+    return check::check_result();
+}
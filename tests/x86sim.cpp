@@ -0,0 +1,400 @@
+#include "x86sim.h"
+
+#include <QStringList>
+
+#include <stdexcept>
+#include <string>
+
+namespace {
+
+constexpr quint32 memory_size = 1 << 20;
+constexpr quint32 data_start = 4096;
+
+const char* const register_names[] = {"eax", "ecx", "edx", "ebx", "esp", "ebp", "esi", "edi"};
+const char* const register8_names[] = {"al", "cl", "dl", "bl"};
+
+int register_index(const QString& name, const char* const* names, int count) {
+    for (int i = 0; i < count; i++)
+        if (name == names[i])
+            return i;
+    return -1;
+}
+
+[[noreturn]] void fail(const QString& message) {
+    throw std::runtime_error(message.toStdString());
+}
+
+quint32 mask(quint8 size) { return size == 1 ? 0xFFu : 0xFFFFFFFFu; }
+
+qint64 signed_value(quint32 value, quint8 size) {
+    return size == 1 ? (qint64)(qint8)value : (qint64)(qint32)value;
+}
+
+quint32 number(const QString& text) {
+    try {
+        return (quint32)std::stoll(text.toStdString(), nullptr, 0);
+    } catch (const std::exception&) {
+        fail(QString("x86sim: not a number: %1").arg(text));
+    }
+}
+
+} // namespace
+
+X86Sim::X86Sim(const QList<AsmLine>& code) : __memory(memory_size, '\0') {
+    layout(code);
+}
+
+/*!
+    Lays the data and bss declarations out from data_start in the order
+    they appear, then decodes the instructions, whose operands may name
+    any of them.
+*/
+void X86Sim::layout(const QList<AsmLine>& code) {
+    struct Raw {
+        QString op, target, source;
+    };
+    std::vector<Raw> raw;
+    QHash<QString, qsizetype> labels;
+    QString section;
+    quint32 next = data_start;
+
+    for (const AsmLine& line : code) {
+        switch (line.kind) {
+        case AsmLine::Kind::Directive: {
+            const QStringList words = line.op.split(' ', Qt::SkipEmptyParts);
+            if (words.size() == 2 && words.at(0) == "section") {
+                section = words.at(1);
+                break;
+            }
+            if (section != ".data" && section != ".bss")
+                break;
+            if (words.size() != 3)
+                fail(QString("x86sim: unknown declaration: %1").arg(line.op));
+
+            __symbols.insert(words.at(0), next);
+            const quint32 value = number(words.at(2));
+            if (words.at(1) == "dd") {
+                for (int i = 0; i < 4; i++)
+                    __memory[next + i] = char(value >> (8 * i));
+                next += 4;
+            }
+            else if (words.at(1) == "resd")
+                next += 4 * value;
+            else if (words.at(1) == "resb")
+                next += value;
+            else
+                fail(QString("x86sim: unknown declaration: %1").arg(line.op));
+            break;
+        }
+        case AsmLine::Kind::Label:
+            labels.insert(line.op, (qsizetype)raw.size());
+            break;
+        case AsmLine::Kind::Instruction:
+            raw.push_back({line.op, line.target, line.source});
+            break;
+        case AsmLine::Kind::Comment:
+        case AsmLine::Kind::Blank:
+            break;
+        }
+    }
+
+    if (!labels.contains("_start"))
+        fail("x86sim: no _start");
+    __start = labels.value("_start");
+
+    for (const Raw& r : raw) {
+        Instruction instruction;
+        instruction.op = r.op;
+        if (r.op.startsWith('j')) {
+            if (!labels.contains(r.target))
+                fail(QString("x86sim: no label %1").arg(r.target));
+            instruction.jump = labels.value(r.target);
+        }
+        else {
+            instruction.target = operand(r.target);
+            instruction.source = operand(r.source);
+        }
+        __code.push_back(instruction);
+    }
+}
+
+X86Sim::Operand X86Sim::operand(QString text) const {
+    Operand result;
+    text = text.trimmed();
+    if (text.isEmpty())
+        return result;
+
+    if (text.startsWith("dword ")) {
+        result.size = 4;
+        text = text.mid(6).trimmed();
+    }
+    else if (text.startsWith("byte ")) {
+        result.size = 1;
+        text = text.mid(5).trimmed();
+    }
+
+    if (text.startsWith('[')) {
+        if (!text.endsWith(']'))
+            fail(QString("x86sim: bad address: %1").arg(text));
+        result.kind = Operand::Memory;
+
+        // Terms joined by + and -: at most one register, symbols, numbers
+        const QString inside = text.mid(1, text.size() - 2);
+        qsizetype at = 0;
+        bool negative = false;
+        while (at < inside.size()) {
+            qsizetype end = at;
+            while (end < inside.size() && inside.at(end) != '+' && inside.at(end) != '-')
+                end++;
+            const QString term = inside.mid(at, end - at).trimmed();
+            const int reg = register_index(term, register_names, REGISTERS);
+
+            if (reg >= 0) {
+                if (result.base >= 0 || negative)
+                    fail(QString("x86sim: bad address: %1").arg(text));
+                result.base = (qint8)reg;
+            }
+            else {
+                const quint32 value = __symbols.contains(term) ? __symbols.value(term) : number(term);
+                result.value += negative ? 0u - value : value;
+            }
+            if (end < inside.size())
+                negative = inside.at(end) == '-';
+            at = end + 1;
+        }
+        return result;
+    }
+
+    if (int reg = register_index(text, register_names, REGISTERS); reg >= 0) {
+        result.kind = Operand::Register;
+        result.value = (quint32)reg;
+    }
+    else if (int reg8 = register_index(text, register8_names, 4); reg8 >= 0) {
+        result.kind = Operand::Register8;
+        result.value = (quint32)reg8;
+    }
+    else if (text.size() == 3 && text.startsWith('\'') && text.endsWith('\'')) {
+        result.kind = Operand::Immediate;
+        result.value = (quint8)text.at(1).toLatin1();
+    }
+    else {
+        result.kind = Operand::Immediate;
+        result.value = __symbols.contains(text) ? __symbols.value(text) : number(text);
+    }
+    return result;
+}
+
+quint32 X86Sim::address(const Operand& operand) const {
+    return (operand.base >= 0 ? __registers[operand.base] : 0) + operand.value;
+}
+
+quint32 X86Sim::read(const Operand& operand, quint8 size) {
+    switch (operand.kind) {
+    case Operand::Register:
+        return __registers[operand.value] & mask(size);
+    case Operand::Register8:
+        return __registers[operand.value] & 0xFFu;
+    case Operand::Immediate:
+        return operand.value & mask(size);
+    case Operand::Memory: {
+        const quint32 at = address(operand);
+        if (at < data_start || at + size > memory_size)
+            fail(QString("x86sim: read outside memory at %1").arg(at));
+        __memory_accesses++;
+        quint32 value = 0;
+        for (quint8 i = 0; i < size; i++)
+            value |= (quint32)(quint8)__memory.at(at + i) << (8 * i);
+        return value;
+    }
+    case Operand::None:
+        break;
+    }
+    fail("x86sim: missing operand");
+}
+
+void X86Sim::write(const Operand& operand, quint8 size, quint32 value) {
+    switch (operand.kind) {
+    case Operand::Register:
+        if (size == 1)
+            __registers[operand.value] = (__registers[operand.value] & ~0xFFu) | (value & 0xFFu);
+        else
+            __registers[operand.value] = value;
+        return;
+    case Operand::Register8:
+        __registers[operand.value] = (__registers[operand.value] & ~0xFFu) | (value & 0xFFu);
+        return;
+    case Operand::Memory: {
+        const quint32 at = address(operand);
+        if (at < data_start || at + size > memory_size)
+            fail(QString("x86sim: write outside memory at %1").arg(at));
+        __memory_accesses++;
+        for (quint8 i = 0; i < size; i++)
+            __memory[at + i] = char(value >> (8 * i));
+        return;
+    }
+    case Operand::Immediate:
+    case Operand::None:
+        break;
+    }
+    fail("x86sim: cannot write to that operand");
+}
+
+void X86Sim::push(quint32 value) {
+    __registers[ESP] -= 4;
+    Operand top;
+    top.kind = Operand::Memory;
+    top.base = ESP;
+    write(top, 4, value);
+}
+
+quint32 X86Sim::pop() {
+    Operand top;
+    top.kind = Operand::Memory;
+    top.base = ESP;
+    const quint32 value = read(top, 4);
+    __registers[ESP] += 4;
+    return value;
+}
+
+//! result is the exact signed result; OF is set when it does not fit.
+void X86Sim::set_flags(qint64 result, quint8 size) {
+    const quint32 truncated = (quint32)result & mask(size);
+    __zero = truncated == 0;
+    __sign = truncated & (size == 1 ? 0x80u : 0x80000000u);
+    __overflow = signed_value(truncated, size) != result;
+}
+
+/*!
+    Returns false on sys_exit.
+*/
+bool X86Sim::system_call() {
+    const quint32 buffer = __registers[ECX];
+    const quint32 length = __registers[EDX];
+
+    switch (__registers[EAX]) {
+    case 1:
+        return false;
+    case 3: {
+        qsizetype end = __input.indexOf('\n');
+        QByteArray line = end < 0 ? __input : __input.left(end + 1);
+        __input.remove(0, line.size());
+        if (end < 0 && !line.isEmpty())
+            line.append('\n');
+        line = line.left(length);
+        if (buffer < data_start || buffer + length > memory_size)
+            fail("x86sim: read outside memory");
+        for (quint32 i = 0; i < length; i++)
+            __memory[buffer + i] = i < (quint32)line.size() ? line.at(i) : '\0';
+        __registers[EAX] = (quint32)line.size();
+        return true;
+    }
+    case 4: {
+        if ((qint32)length < 0 || buffer < data_start || buffer + length > memory_size)
+            fail("x86sim: write outside memory");
+        for (quint32 i = 0; i < length; i++)
+            if (__memory.at(buffer + i) != '\0')
+                __output.append(__memory.at(buffer + i));
+        __output.append('\n');
+        __registers[EAX] = length;
+        return true;
+    }
+    default:
+        fail(QString("x86sim: unknown system call %1").arg(__registers[EAX]));
+    }
+}
+
+void X86Sim::run(const QByteArray& input, qint64 max_steps) {
+    __input = input;
+    __registers[ESP] = memory_size - 16;
+
+    for (qsizetype pc = __start; pc < (qsizetype)__code.size();) {
+        if (++__steps > max_steps)
+            fail("x86sim: step limit");
+
+        const Instruction& in = __code[pc++];
+        const QString& op = in.op;
+        const quint8 size = in.target.kind == Operand::Register8 ||
+                                    in.source.kind == Operand::Register8 ||
+                                    in.target.size == 1 || in.source.size == 1
+                                ? 1 : 4;
+
+        if (op == "mov")
+            write(in.target, size, read(in.source, size));
+        else if (op == "add" || op == "sub" || op == "cmp" || op == "imul") {
+            const qint64 a = signed_value(read(in.target, size), size);
+            const qint64 b = signed_value(read(in.source, size), size);
+            const qint64 result = op == "add" ? a + b : op == "imul" ? a * b : a - b;
+            set_flags(result, size);
+            if (op != "cmp")
+                write(in.target, size, (quint32)result);
+        }
+        else if (op == "xor" || op == "test") {
+            const quint32 result = read(in.target, size) & mask(size);
+            const quint32 other = read(in.source, size) & mask(size);
+            const quint32 value = op == "xor" ? result ^ other : result & other;
+            set_flags(signed_value(value, size), size);
+            if (op == "xor")
+                write(in.target, size, value);
+        }
+        else if (op == "neg" || op == "inc" || op == "dec") {
+            const qint64 a = signed_value(read(in.target, size), size);
+            const qint64 result = op == "neg" ? -a : op == "inc" ? a + 1 : a - 1;
+            set_flags(result, size);
+            write(in.target, size, (quint32)result);
+        }
+        else if (op == "push")
+            push(read(in.target, 4));
+        else if (op == "pop")
+            write(in.target, 4, pop());
+        else if (op == "cdq")
+            __registers[EDX] = (__registers[EAX] & 0x80000000u) ? 0xFFFFFFFFu : 0;
+        else if (op == "idiv") {
+            const qint64 dividend = (qint64)(((quint64)__registers[EDX] << 32) | __registers[EAX]);
+            const qint64 divisor = (qint32)read(in.target, 4);
+            if (divisor == 0)
+                fail("x86sim: division by zero");
+            const qint64 quotient = dividend / divisor;
+            if (quotient != (qint32)quotient)
+                fail("x86sim: quotient overflow");
+            __registers[EAX] = (quint32)quotient;
+            __registers[EDX] = (quint32)(dividend % divisor);
+        }
+        else if (op == "div") {
+            const quint64 dividend = ((quint64)__registers[EDX] << 32) | __registers[EAX];
+            const quint64 divisor = read(in.target, 4);
+            if (divisor == 0)
+                fail("x86sim: division by zero");
+            if (dividend / divisor > 0xFFFFFFFFu)
+                fail("x86sim: quotient overflow");
+            __registers[EAX] = (quint32)(dividend / divisor);
+            __registers[EDX] = (quint32)(dividend % divisor);
+        }
+        else if (op == "jmp")
+            pc = in.jump;
+        else if (op == "je" || op == "jz") {
+            if (__zero)
+                pc = in.jump;
+        }
+        else if (op == "jne" || op == "jnz") {
+            if (!__zero)
+                pc = in.jump;
+        }
+        else if (op == "jge") {
+            if (__sign == __overflow)
+                pc = in.jump;
+        }
+        else if (op == "jl") {
+            if (__sign != __overflow)
+                pc = in.jump;
+        }
+        else if (op == "int") {
+            if (in.target.value != 0x80)
+                fail("x86sim: only int 0x80");
+            if (!system_call())
+                return;
+        }
+        else
+            fail(QString("x86sim: unknown instruction %1").arg(op));
+    }
+    fail("x86sim: ran past the end of the code");
+}
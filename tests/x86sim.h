@@ -0,0 +1,77 @@
+#ifndef X86SIM_H
+#define X86SIM_H
+
+#include "peephole.h"
+
+#include <QByteArray>
+#include <QHash>
+#include <QList>
+#include <QString>
+
+#include <vector>
+
+/*!
+    Runs the NASM code AsmGenerator emits, so the tests can check what a
+    compiled program prints without an assembler: the i386 instructions
+    the generator uses, over a flat memory, and the read, write and exit
+    system calls. Anything else throws std::runtime_error, so a new
+    instruction in the generator shows up as a failing test rather than
+    as a wrong result.
+
+    A read takes one line of the input, as it would from a terminal. A
+    write appends its bytes without the NUL ones, and ends the line.
+*/
+class X86Sim {
+public:
+    struct Operand {
+        enum Kind : quint8 { None, Register, Register8, Immediate, Memory };
+        Kind kind = None;
+        quint8 size = 0;        // bytes, 0 if the instruction decides
+        qint8 base = -1;        // register of a memory operand, -1 if none
+        quint32 value = 0;      // register, immediate or displacement
+    };
+
+    struct Instruction {
+        QString op;
+        Operand target;
+        Operand source;
+        qsizetype jump = -1;    // instruction a jump goes to
+    };
+
+private:
+    enum Reg : quint8 { EAX, ECX, EDX, EBX, ESP, EBP, ESI, EDI, REGISTERS };
+
+    std::vector<Instruction> __code;
+    qsizetype __start = 0;
+    QHash<QString, quint32> __symbols;
+    QByteArray __memory;
+    quint32 __registers[REGISTERS] = {};
+    bool __zero = false, __sign = false, __overflow = false;
+
+    QByteArray __input;
+    QByteArray __output;
+    qint64 __steps = 0;
+    qint64 __memory_accesses = 0;
+
+    void layout(const QList<AsmLine>& code);
+    Operand operand(QString text) const;
+    quint32 address(const Operand& operand) const;
+    quint32 read(const Operand& operand, quint8 size);
+    void write(const Operand& operand, quint8 size, quint32 value);
+    void push(quint32 value);
+    quint32 pop();
+    void set_flags(qint64 result, quint8 size);
+    bool system_call();
+
+public:
+    explicit X86Sim(const QList<AsmLine>& code);
+
+    //! Runs from _start to sys_exit on input; throws after max_steps.
+    void run(const QByteArray& input, qint64 max_steps = 50'000'000);
+
+    const QByteArray& output() const { return __output; }
+    qint64 steps() const { return __steps; }
+    qint64 memory_accesses() const { return __memory_accesses; }
+};
+
+#endif // X86SIM_H
@@ -3,712 +3,808 @@
 #define ASMGENERATOR_H
 
 #include "lexer.h"
-#include <QMap>
+#include "ir.h"
+#include "peephole.h"
+#include "regalloc.h"
+#include "variables.h"
+#include <QList>
 #include <QFile>
 #include <QTextStream>
-#include <QStack>
-#include <QSet>
 
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+/*!
+    Lowers a program in SSA form to NASM code for Linux i386. Blocks are
+    emitted in the order of the function, under their own labels, and a
+    jump to the block that follows is left out.
+
+    An arithmetic value without a variable that is used once, further
+    down its own block, is folded into the expression tree of its user,
+    which evaluate() computes in the scratch registers by Sethi-Ullman
+    numbers. Every other value gets a callee-saved register from the
+    linear-scan allocator, or stays in memory if there are too few:
+    versions of a variable in the variable's slot in .bss, which the
+    builder never needs for two versions at once, other values in a slot
+    of their own. A phi needs no code but the copies on the edges into its
+    block. Input clobbers ebx and esi and output clobbers ebx, so values
+    kept there across them are pushed before and popped after.
+*/
 class AsmGenerator {
 private:
-    Lexer* __lexer;
-    QMap<QString, int> __variable_sizes;
-    QMap<QString, QString> __variable_types;
-    QList<QString> __generated_code;
-    QStack<QString> __loop_labels;
-    QStack<QString> __if_labels;
-    int __label_counter = 0;
-    int __temp_counter = 0;
-    int __loop_depth = 0;
-    int __if_depth = 0;
-    int __current_token_index = 0;
-    QString __current_program_name;
-    QSet<QString> __declared_variables;
-    bool __in_program = false;
-
-    struct LoopContext {
-        QString start_label;
-        QString end_label;
-        QString condition_label;
-        bool is_for_loop = false;
-        QString increment_code;
+    /*!
+        Expressions are evaluated in the scratch registers, in the order
+        they are taken; edx comes last since every division needs it.
+        The others hold allocated values, those input and output leave
+        alone first, then esi, which only input clobbers, and are taken
+        for expressions where they hold none.
+    */
+    enum Register : quint8 { EAX, ECX, EDX, SCRATCH, EDI = SCRATCH, EBP, ESI, EBX, REGISTERS };
+    static constexpr const char* register_names[REGISTERS] = {
+        "eax", "ecx", "edx", "edi", "ebp", "esi", "ebx"
     };
+    static constexpr int allocated_registers = REGISTERS - SCRATCH;
 
-    QStack<LoopContext> __loop_contexts;
+    struct Operand {
+        enum Kind { Immediate, Memory, InRegister, OnStack };
+        QString text;       // as written in an instruction
+        Kind kind;
+        Register reg = REGISTERS;
+    };
+
+    const Lexer* __lexer;
+    const ir::Function* __function;
+    VariableTable* __variables;
+    QList<AsmLine> __generated_code;
+    PeepholeOptimizer __peephole;
+    QList<QString> __ids;               // id names by symbol, decoded once
+    std::vector<qint32> __uses;         // operands that are the value
+    std::vector<char> __folded;         // evaluated inside the tree of its user
+    std::vector<qint32> __temps;        // slot number of a value without a variable
+    qint32 __temp_count = 0;
+    std::vector<quint8> __need;         // Sethi-Ullman number, 0 until computed
+    ir::LinearScan __allocation;
+    quint8 __busy = 0;                  // bit per Register holding a value
+    int __label_counter = 0;
 
 public:
-    AsmGenerator(Lexer* lex) : __lexer(lex) {}
+    /*!
+        Code is generated from the function the IR builder made of the
+        parsed program. Variables come from the table the semantic
+        analyzer declared them in; the generator records their storage in
+        it.
+    */
+    AsmGenerator(const Lexer* lex, const ir::Function* function, VariableTable* variables)
+        : __lexer(lex), __function(function), __variables(variables),
+          __allocation(function, allocated_registers) {}
 
     bool generate(const QString& output_filename = "output.asm") {
         __generated_code.clear();
         __label_counter = 0;
-        __temp_counter = 0;
-        __loop_depth = 0;
-        __if_depth = 0;
-        __current_token_index = 0;
-        __current_program_name.clear();
-        __declared_variables.clear();
-        __in_program = false;
-        __loop_contexts.clear();
-        __loop_labels.clear();
-        __if_labels.clear();
+
+        const SymbolTable& ids = __lexer->get_ids();
+        __ids.clear();
+        __ids.reserve(ids.size());
+        for (qint32 id = 0; id < ids.size(); id++)
+            __ids.append(ids.value(id));
+
+        __busy = 0;
+        analyzeValues();
+        __allocation.run(__folded);
 
         generateDataSection();
         generateCodeSection();
+        __peephole.run(__generated_code);
 
         return writeToFile(output_filename);
     }
 
+    //! What the peephole rules did to the code generated so far.
+    const PeepholeOptimizer& peephole() const { return __peephole; }
+    const ir::LinearScan& allocation() const { return __allocation; }
+    //! The code generate() wrote, after the peephole rules.
+    const QList<AsmLine>& code() const { return __generated_code; }
+
     QString getNextLabel(const QString& prefix = "L") {
         return QString("%1%2").arg(prefix).arg(__label_counter++);
     }
 
 private:
+    void emit(const QString& op, const QString& target = {}, const QString& source = {},
+              const QString& comment = {}) {
+        __generated_code.append({AsmLine::Kind::Instruction, op, target, source, comment});
+    }
+
+    void emitLine(AsmLine::Kind kind, const QString& text = {}) {
+        __generated_code.append({kind, text, {}, {}, {}});
+    }
+
+    void emitLabel(const QString& name) { emitLine(AsmLine::Kind::Label, name); }
+    void emitComment(const QString& text) { emitLine(AsmLine::Kind::Comment, text); }
+    void emitBlank() { emitLine(AsmLine::Kind::Blank); }
+    void emitDirective(const QString& text) { emitLine(AsmLine::Kind::Directive, text); }
+
     void generateDataSection() {
-        __generated_code.append("section .data");
-        __generated_code.append("");
+        emitDirective("section .data");
+        emitBlank();
 
         // Process constants from lexer
-        auto consts = __lexer->get_consts();
-        for (const auto& lex : consts) {
-            QString const_name = lex.const_name().isEmpty() ?
-                                     QString("const_%1").arg(lex.value()) :
-                                     lex.const_name();
+        const SymbolTable& consts = __lexer->get_consts();
+        for (qint32 id = 0; id < consts.size(); id++) {
+            QString value = consts.value(id);
+            QString const_name = QString("const_%1").arg(value);
 
-            __generated_code.append(QString("    %1 dd %2").arg(const_name, lex.value()));
+            emitDirective(QString("    %1 dd %2").arg(const_name, value));
         }
 
-        __generated_code.append("");
+        emitBlank();
     }
 
     void generateCodeSection() {
-        __generated_code.append("section .text");
-        __generated_code.append("global _start");
-        __generated_code.append("");
-        __generated_code.append("_start:");
-        __generated_code.append("");
-
-        auto tokens = __lexer->get_tokenized_code();
-        __current_token_index = 0;
-
-        // Reset state for new program
-        resetProgramState();
+        emitDirective("section .text");
+        emitDirective("global _start");
+        emitBlank();
+        emitLabel("_start");
 
-        // Process all tokens
-        while (__current_token_index < tokens.size()) {
-            processToken(tokens);
+        // program a E begin E end .
+        const TokenStore& tokens = __lexer->get_tokenized_code();
+        if (tokens.size() > 1 && tokens.at(1).type() == TokenType::Id) {
+            emitBlank();
+            emitComment(QString("Program: %1").arg(__ids.at(tokens.at(1).symbol())));
         }
 
-        // Add program exit
-        __generated_code.append("");
-        __generated_code.append("    ; Exit program");
-        __generated_code.append("    mov eax, 1      ; sys_exit");
-        __generated_code.append("    xor ebx, ebx    ; exit code 0");
-        __generated_code.append("    int 0x80");
-        __generated_code.append("");
+        for (ir::Block block = 0; block < __function->block_count(); block++)
+            generateBlock(block);
 
         generateHelperFunctions();
     }
 
-    void resetProgramState() {
-        __loop_depth = 0;
-        __if_depth = 0;
-        __loop_contexts.clear();
-        __loop_labels.clear();
-        __if_labels.clear();
-        __declared_variables.clear();
-        __in_program = false;
-        __current_program_name.clear();
-    }
-
-    void processToken(const QList<Lexema>& tokens) {
-        auto& token = tokens[__current_token_index];
-
-        if (token.value() == "program") {
-            // Start of a new program
-            if (__in_program) {
-                // Close previous program if any
-                closeAllBlocks();
-            }
-
-            resetProgramState();
-            __in_program = true;
-
-            if (__current_token_index + 1 < tokens.size()) {
-                __current_program_name = tokens[__current_token_index + 1].value();
-                __generated_code.append("");
-                __generated_code.append(QString("    ; Program: %1").arg(__current_program_name));
+    // Values
+
+    const ir::Instruction& at(ir::Value value) const { return __function->at(value); }
+
+    /*!
+        Counts the uses of every value and decides which are folded into
+        their user. Between a folded value and its user there may only be
+        constants and other folded values, none of which reads or writes
+        memory, so the operands of the tree still hold what they held
+        where the value was defined. Blocks are swept backwards, so the
+        instructions after a value are decided first.
+    */
+    void analyzeValues() {
+        const qsizetype size = __function->size();
+        __uses.assign(size, 0);
+        __folded.assign(size, 0);
+        __temps.assign(size, -1);
+        __need.assign(size, 0);
+        __temp_count = 0;
+
+        std::vector<ir::Value> user(size, ir::no_value);
+        std::vector<qsizetype> position(size, 0);
+        for (ir::Block block = 0; block < __function->block_count(); block++) {
+            const QList<ir::Value>& instructions = __function->block(block).instructions;
+            for (qsizetype i = 0; i < instructions.size(); i++) {
+                const ir::Value value = instructions.at(i);
+                position[value] = i;
+                for (qsizetype k = 0; k < __function->operand_count(value); k++) {
+                    const ir::Value operand = __function->operand(value, k);
+                    __uses[operand]++;
+                    user[operand] = value;
+                }
             }
-
-            __current_token_index += 2; // Skip "program" and program name
         }
-        else if (token.value() == "var") {
-            // Variable declaration section
-            __current_token_index++; // Skip "var"
 
-            // Collect variable names until "int" or "integer"
-            while (__current_token_index < tokens.size()) {
-                QString token_value = tokens[__current_token_index].value();
+        for (ir::Block block = 0; block < __function->block_count(); block++) {
+            const QList<ir::Value>& instructions = __function->block(block).instructions;
+            qsizetype barrier = instructions.size();
+            for (qsizetype i = instructions.size() - 1; i >= 0; i--) {
+                const ir::Value value = instructions.at(i);
+                const ir::Instruction& instruction = at(value);
+                const ir::Value use = user[value];
 
-                if (token_value == "int" || token_value == "integer") {
-                    __current_token_index++; // Skip "int" or "integer"
-                    break;
-                }
+                __folded[value] = ir::is_arithmetic(instruction.op) &&
+                    instruction.variable < 0 && __uses[value] == 1 &&
+                    at(use).block == block && at(use).op != ir::Opcode::Phi &&
+                    position[use] <= barrier;
 
-                if (token.type() == TokenType::Id || token.type() == TokenType::Word) {
-                    if (token_value != ",") {
-                        __declared_variables.insert(token_value);
-                        // Declare variable in .bss section
-                        if (!__variable_sizes.contains(token_value)) {
-                            __variable_sizes[token_value] = 4;
-                            __variable_types[token_value] = "dd";
-                        }
-                    }
-                }
-
-                __current_token_index++;
+                if (!__folded[value] && instruction.op != ir::Opcode::Const)
+                    barrier = i;
             }
         }
-        else if (token.value() == "begin") {
-            __current_token_index++;
-            __generated_code.append("    ; Begin main block");
-        }
-        else if (token.value() == "end") {
-            // Check if it's "end." (end of program)
-            if (__current_token_index + 1 < tokens.size() &&
-                tokens[__current_token_index + 1].value() == ".") {
-                closeAllBlocks();
-                __current_token_index += 2; // Skip "end" and "."
-                __generated_code.append("    ; End program");
-                __in_program = false;
-                return;
-            }
-
-            // Close current block
-            closeCurrentBlock();
-            __current_token_index++;
-        }
-        else if (token.value() == "if") {
-            processIfStatement(tokens);
-        }
-        else if (token.value() == "else") {
-            processElseStatement(tokens);
-        }
-        else if (token.value() == "while") {
-            processWhileLoop(tokens);
-        }
-        else if (token.value() == "for") {
-            processForLoop(tokens);
-        }
-        else if (token.value() == "let") {
-            processAssignment(tokens);
-        }
-        else if (token.value() == "input") {
-            processInput(tokens);
-        }
-        else if (token.value() == "output") {
-            processOutput(tokens);
-        }
-        else if (token.value() == "then") {
-            // Skip "then" keyword
-            __current_token_index++;
-        }
-        else if (token.value() == ";") {
-            __generated_code.append("    ; Statement end");
-            __current_token_index++;
-        }
-        else if (token.type() == TokenType::Id && __declared_variables.contains(token.value())) {
-            // Variable reference - handled in other contexts
-            __current_token_index++;
-        }
-        else {
-            __current_token_index++; // Skip other tokens
-        }
     }
 
-    void processIfStatement(const QList<Lexema>& tokens) {
-        QString else_label = getNextLabel("ELSE_");
-        QString end_if_label = getNextLabel("END_IF_");
-
-        __if_labels.push(else_label);
-        __if_labels.push(end_if_label);
-
-        __generated_code.append("");
-        __generated_code.append("    ; If statement");
-
-        __current_token_index++; // Skip "if"
-
-        if (__current_token_index < tokens.size() && tokens[__current_token_index].value() == "(") {
-            __current_token_index++; // Skip "("
-
-            QString condition = extractCondition(tokens);
-            generateConditionCode(condition, else_label);
-
-            __current_token_index++; // Skip ")"
-        }
+    //! The memory of a value: its variable or a temporary.
+    QString home(ir::Value value) {
+        if (at(value).variable >= 0)
+            return QString("[%1]").arg(__ids.at(at(value).variable));
+        if (__temps[value] < 0)
+            __temps[value] = __temp_count++;
+        return QString("[__t%1]").arg(__temps[value]);
     }
 
-    void processElseStatement(const QList<Lexema>& tokens) {
-        if (!__if_labels.isEmpty()) {
-            QString else_label = __if_labels.pop();
-            QString end_if_label = __if_labels.pop();
+    //! The register the allocator gave a value, REGISTERS if none.
+    Register registerOf(ir::Value value) const {
+        const int reg = __allocation.register_of(value);
+        return reg < 0 ? REGISTERS : Register(SCRATCH + reg);
+    }
 
-            __generated_code.append("    jmp " + end_if_label);
-            __generated_code.append(else_label + ":");
-            __generated_code.append("    ; Else block");
+    //! A value evaluate() does not compute: a const or a value in a register or memory.
+    bool isLeaf(ir::Value value) const { return !__folded[value]; }
 
-            __if_labels.push(end_if_label);
-        }
-        __current_token_index++;
+    //! Where a value that is not folded lives.
+    Operand location(ir::Value value) {
+        const Register reg = registerOf(value);
+        if (reg != REGISTERS)
+            return {register_names[reg], Operand::InRegister, reg};
+        return {home(value), Operand::Memory};
     }
 
-    void processWhileLoop(const QList<Lexema>& tokens) {
-        __loop_depth++;
-
-        LoopContext context;
-        context.start_label = getNextLabel("WHILE_START_");
-        context.end_label = getNextLabel("WHILE_END_");
-        context.condition_label = getNextLabel("WHILE_COND_");
-        context.is_for_loop = false;
+    Operand leafOperand(ir::Value value) {
+        if (at(value).op == ir::Opcode::Const)
+            return {QString::number(at(value).immediate), Operand::Immediate};
+        return location(value);
+    }
 
-        __loop_contexts.push(context);
+    //! Copies a leaf to where a value lives, through eax if both are memory.
+    void emitMove(const Operand& destination, const Operand& source) {
+        if (destination.text == source.text)
+            return;
+        if (destination.kind == Operand::Memory && source.kind == Operand::Memory) {
+            emit("mov", "eax", source.text);
+            emit("mov", destination.text, "eax");
+        }
+        else if (destination.kind == Operand::Memory && source.kind == Operand::Immediate)
+            emit("mov", "dword " + destination.text, source.text);
+        else
+            emit("mov", destination.text, source.text);
+    }
 
-        __generated_code.append("");
-        __generated_code.append("    ; While loop");
-        __generated_code.append(context.condition_label + ":");
+    /*!
+        The registers holding values across an input or output that it
+        clobbers: input reads the digits through esi and both pass a file
+        descriptor in ebx. They are pushed before it and popped after,
+        rather than stored to their homes, since a range of the interval
+        where the value is dead may share its home with a live version.
+    */
+    QList<Register> clobberedAcross(ir::Value instruction) const {
+        const quint32 live = __allocation.live_through(instruction) << SCRATCH;
+        const quint32 clobbered = at(instruction).op == ir::Opcode::Input
+                                      ? registerBit(ESI) | registerBit(EBX)
+                                      : registerBit(EBX);
+        QList<Register> saved;
+        for (Register reg : {ESI, EBX})
+            if (live & clobbered & registerBit(reg))
+                saved.append(reg);
+        return saved;
+    }
 
-        __current_token_index++; // Skip "while"
+    //! The source an instruction was made from, on one line, for the comments.
+    QString sourceText(const ir::Instruction& instruction) const {
+        const TokenStore& tokens = __lexer->get_tokenized_code();
+        const Lexema first = tokens.at(instruction.first_token);
+        const Lexema last = tokens.at(instruction.last_token);
+        const qsizetype length = last.offset() + last.text().size() - first.offset();
+        return QString::fromUtf8(__lexer->get_source()->view(first.offset(), length)).simplified();
+    }
 
-        if (__current_token_index < tokens.size() && tokens[__current_token_index].value() == "(") {
-            __current_token_index++; // Skip "("
+    // Blocks
 
-            QString condition = extractCondition(tokens);
-            generateConditionCode(condition, context.end_label);
+    void generateBlock(ir::Block block) {
+        const ir::BasicBlock& basic_block = __function->block(block);
+        emitBlank();
+        emitLabel(basic_block.label);
 
-            __current_token_index++; // Skip ")"
-        }
+        for (ir::Value value : basic_block.instructions) {
+            const ir::Instruction& instruction = at(value);
+            if (__folded[value])
+                continue;
 
-        __generated_code.append(context.start_label + ":");
+            // Registers holding values the instruction needs are not scratch
+            __busy = quint8(__allocation.live_at(value) << SCRATCH);
 
-        // Check for "begin" after condition
-        if (__current_token_index < tokens.size() && tokens[__current_token_index].value() == "begin") {
-            __current_token_index++; // Skip "begin"
+            switch (instruction.op) {
+            case ir::Opcode::Const:
+            case ir::Opcode::Phi:
+                // Consts are immediates, phis are copied into on the edges
+                break;
+            case ir::Opcode::Input:
+                generateInputCode(value);
+                break;
+            case ir::Opcode::Output:
+                generateOutputCode(value);
+                break;
+            case ir::Opcode::Jump:
+                generatePhiCopies(block, instruction.targets[0]);
+                generateJump(block, instruction.targets[0]);
+                break;
+            case ir::Opcode::Branch:
+                generateBranchCode(block, value);
+                break;
+            case ir::Opcode::Return:
+                generateExitCode();
+                break;
+            default:
+                generateAssignmentCode(value);
+                break;
+            }
         }
     }
 
-    void processForLoop(const QList<Lexema>& tokens) {
-        __loop_depth++;
-
-        LoopContext context;
-        context.start_label = getNextLabel("FOR_START_");
-        context.end_label = getNextLabel("FOR_END_");
-        context.condition_label = getNextLabel("FOR_COND_");
-        context.is_for_loop = true;
-
-        __loop_contexts.push(context);
-
-        __generated_code.append("");
-        __generated_code.append("    ; For loop");
-
-        __current_token_index++; // Skip "for"
-
-        if (__current_token_index < tokens.size() && tokens[__current_token_index].value() == "(") {
-            __current_token_index++; // Skip "("
-
-            // Parse initialization
-            QString initialization = "";
-            while (__current_token_index < tokens.size() &&
-                   tokens[__current_token_index].value() != ";") {
-                initialization += tokens[__current_token_index].value() + " ";
-                __current_token_index++;
-            }
-            initialization = initialization.trimmed();
+    //! A jump to the block that follows is left out.
+    void generateJump(ir::Block from, ir::Block to) {
+        if (to != from + 1)
+            emit("jmp", __function->block(to).label);
+    }
 
-            if (!initialization.isEmpty()) {
-                // Handle initialization (could be "1" or "let i = 0")
-                if (initialization != "1") { // Skip constant "1"
-                    processAssignmentFromString(initialization);
-                }
-            }
+    /*!
+        The copies into the phis of to along the edge from from, which
+        happen at once. A copy from a place to itself is left out; one
+        whose destination no other copy still reads goes first, and when
+        only a cycle of copies is left one source is moved to ecx and
+        read from there. Memory to memory goes through eax.
+    */
+    void generatePhiCopies(ir::Block from, ir::Block to) {
+        const ir::BasicBlock& target = __function->block(to);
+        const qsizetype edge = target.predecessors.indexOf(from);
+
+        QList<std::pair<Operand, Operand>> copies;
+        for (ir::Value phi : target.instructions) {
+            if (at(phi).op != ir::Opcode::Phi)
+                break;
+            const Operand source = leafOperand(__function->operand(phi, edge));
+            const Operand destination = location(phi);
+            if (source.text != destination.text)
+                copies.append({destination, source});
+        }
 
-            if (__current_token_index < tokens.size() && tokens[__current_token_index].value() == ";") {
-                __current_token_index++;
-            }
+        auto isRead = [&](const Operand& place) {
+            for (const auto& [destination, source] : copies)
+                if (source.text == place.text)
+                    return true;
+            return false;
+        };
 
-            __generated_code.append(context.condition_label + ":");
+        while (!copies.isEmpty()) {
+            qsizetype ready = 0;
+            while (ready < copies.size() && isRead(copies.at(ready).first))
+                ready++;
 
-            // Parse condition
-            QString condition = "";
-            while (__current_token_index < tokens.size() &&
-                   tokens[__current_token_index].value() != ";") {
-                condition += tokens[__current_token_index].value() + " ";
-                __current_token_index++;
+            if (ready < copies.size()) {
+                emitMove(copies.at(ready).first, copies.at(ready).second);
+                copies.removeAt(ready);
+                continue;
             }
-            condition = condition.trimmed();
 
-            if (!condition.isEmpty() && condition != "1") { // Skip constant "1"
-                generateConditionCode(condition, context.end_label);
-            } else if (condition == "1") {
-                // Always true condition
-                __generated_code.append("    ; Always true condition");
-            }
+            // Every destination is still read: break the cycle at the first copy
+            const Operand blocked = copies.first().first;
+            const Operand temporary{"ecx", Operand::InRegister, ECX};
+            emitMove(temporary, blocked);
+            for (auto& [destination, source] : copies)
+                if (source.text == blocked.text)
+                    source = temporary;
+        }
+    }
 
-            if (__current_token_index < tokens.size() && tokens[__current_token_index].value() == ";") {
-                __current_token_index++;
-            }
+    void generateBranchCode(ir::Block block, ir::Value branch) {
+        const ir::Instruction& instruction = at(branch);
+        const ir::Value condition = __function->operand(branch, 0);
+        const QString& true_label = __function->block(instruction.targets[0]).label;
+        const QString& false_label = __function->block(instruction.targets[1]).label;
 
-            // Parse increment
-            QString increment = "";
-            while (__current_token_index < tokens.size() &&
-                   tokens[__current_token_index].value() != ")") {
-                increment += tokens[__current_token_index].value() + " ";
-                __current_token_index++;
-            }
-            increment = increment.trimmed();
-            context.increment_code = increment;
+        if (instruction.first_token >= 0)
+            emitComment(QString("Condition: %1").arg(sourceText(instruction)));
 
-            if (__current_token_index < tokens.size() && tokens[__current_token_index].value() == ")") {
-                __current_token_index++;
+        // A constant condition is decided here
+        if (at(condition).op == ir::Opcode::Const) {
+            if (at(condition).immediate != 0) {
+                emitComment("Always true condition");
+                generateJump(block, instruction.targets[0]);
             }
+            else
+                emit("jmp", false_label);
+            return;
+        }
 
-            __generated_code.append(context.start_label + ":");
-
-            // Check for "begin" after for loop
-            if (__current_token_index < tokens.size() && tokens[__current_token_index].value() == "begin") {
-                __current_token_index++; // Skip "begin"
-            }
+        // Check if result is zero (false)
+        if (isLeaf(condition) && registerOf(condition) != REGISTERS)
+            emit("cmp", register_names[registerOf(condition)], "0");
+        else {
+            Register value = evaluate(condition);
+            release(value);
+            emit("cmp", register_names[value], "0");
         }
+        emit("je", false_label);
+        if (instruction.targets[0] != block + 1)
+            emit("jmp", true_label);
     }
 
-    void processAssignment(const QList<Lexema>& tokens) {
-        if (__current_token_index + 3 < tokens.size() &&
-            tokens[__current_token_index + 2].value() == "=") {
+    void generateExitCode() {
+        emitComment("End program");
+        emitBlank();
+        emitComment("Exit program");
+        emit("mov", "eax", "1", "sys_exit");
+        emit("xor", "ebx", "ebx", "exit code 0");
+        emit("int", "0x80");
+    }
 
-            QString var_name = tokens[__current_token_index + 1].value();
-            QString expr = extractExpression(__current_token_index + 3, tokens);
+    void generateInputCode(ir::Value input) {
+        const QString var_name = __ids.at(at(input).variable);
+        emitBlank();
+        emitComment(QString("Input to %1").arg(var_name));
 
-            generateAssignmentCode(var_name, expr);
+        const QString convert = getNextLabel("convert_input_");
+        const QList<Register> saved = clobberedAcross(input);
+        for (Register r : saved)
+            emit("push", register_names[r]);
 
-            __current_token_index += 4; // Skip "let", var, "=", and expr
-        } else {
-            __current_token_index++;
-        }
+        // Simple inline input (without function call for simplicity)
+        emit("mov", "eax", "3", "sys_read");
+        emit("mov", "ebx", "0", "stdin");
+        emit("mov", "ecx", "input_buffer");
+        emit("mov", "edx", "12", "buffer size");
+        emit("int", "0x80");
+        emitBlank();
+        emitComment("Convert string to integer");
+        emit("mov", "esi", "input_buffer");
+        emit("xor", "eax", "eax");
+        emit("xor", "ebx", "ebx");
+        emit("mov", "ecx", "10");
+        emitLabel(convert);
+        emit("mov", "bl", "[esi]");
+        emit("cmp", "bl", "0");
+        emit("je", convert + "_done");
+        emit("cmp", "bl", "10", "newline");
+        emit("je", convert + "_done");
+        emit("sub", "bl", "'0'");
+        emit("imul", "eax", "ecx");
+        emit("add", "eax", "ebx");
+        emit("inc", "esi");
+        emit("jmp", convert);
+        emitLabel(convert + "_done");
+        for (qsizetype i = saved.size() - 1; i >= 0; i--)
+            emit("pop", register_names[saved.at(i)]);
+        emit("mov", location(input).text, "eax");
     }
 
-    void processAssignmentFromString(const QString& assignment) {
-        QStringList parts = assignment.split(" ", Qt::SkipEmptyParts);
+    void generateOutputCode(ir::Value output) {
+        emitBlank();
+        if (at(output).first_token >= 0)
+            emitComment(sourceText(at(output)));
 
-        if (parts.size() >= 3 && parts[1] == "=") {
-            QString var_name = parts[0];
-            if (parts[0] == "let" && parts.size() >= 4) {
-                var_name = parts[1];
-            }
+        Register value = evaluate(__function->operand(output, 0));
+        if (value != EAX)
+            emit("mov", "eax", register_names[value]);
+        release(value);
 
-            QString expr = "";
-            for (int i = 2; i < parts.size(); i++) {
-                expr += parts[i] + " ";
-            }
-            expr = expr.trimmed();
+        const QString positive = getNextLabel("output_positive_");
+        const QString convert = getNextLabel("output_convert_");
+        const QList<Register> saved = clobberedAcross(output);
+        for (Register r : saved)
+            emit("push", register_names[r]);
 
-            generateAssignmentCode(var_name, expr);
-        }
+        // Convert to string and output
+        emitComment("Convert to string");
+        emit("mov", "ebx", "10");
+        emit("mov", "ecx", "output_buffer");
+        emit("add", "ecx", "11");
+        emit("mov", "byte [ecx]", "0");
+        emit("dec", "ecx");
+        emit("mov", "byte [ecx]", "10", "newline");
+        emitBlank();
+        emit("cmp", "eax", "0");
+        emit("jge", positive);
+        emit("neg", "eax");
+        emit("mov", "byte [output_buffer]", "'-'");
+        emitLabel(positive);
+        emitLabel(convert);
+        emit("xor", "edx", "edx");
+        emit("div", "ebx");
+        emit("add", "dl", "'0'");
+        emit("mov", "[ecx]", "dl");
+        emit("dec", "ecx");
+        emit("test", "eax", "eax");
+        emit("jnz", convert);
+        emitBlank();
+        emit("inc", "ecx");
+        emit("mov", "eax", "4", "sys_write");
+        emit("mov", "ebx", "1", "stdout");
+        emit("mov", "edx", "12");
+        emit("sub", "edx", "ecx");
+        emit("add", "edx", "output_buffer");
+        emit("int", "0x80");
+        for (qsizetype i = saved.size() - 1; i >= 0; i--)
+            emit("pop", register_names[saved.at(i)]);
     }
 
-    void processInput(const QList<Lexema>& tokens) {
-        if (__current_token_index + 3 < tokens.size() &&
-            tokens[__current_token_index + 1].value() == "(") {
+    //! A value that is not folded is computed into its register or slot.
+    void generateAssignmentCode(ir::Value value) {
+        emitBlank();
+        if (at(value).first_token >= 0)
+            emitComment(sourceText(at(value)));
 
-            QString var_name = tokens[__current_token_index + 2].value();
-            generateInputCode(var_name);
-
-            __current_token_index += 4; // Skip "input", "(", var, ")"
-        } else {
-            __current_token_index++;
+        const Operand destination = location(value);
+        if (at(value).op == ir::Opcode::Copy && isLeaf(__function->operand(value, 0))) {
+            emitMove(destination, leafOperand(__function->operand(value, 0)));
+            return;
         }
-    }
 
-    void processOutput(const QList<Lexema>& tokens) {
-        if (__current_token_index + 3 < tokens.size() &&
-            tokens[__current_token_index + 1].value() == "(") {
+        if (destination.kind == Operand::InRegister && generateInPlace(value, destination.reg))
+            return;
 
-            QString expr = extractExpression(__current_token_index + 2, tokens);
-            generateOutputCode(expr);
-
-            __current_token_index += 4; // Skip "output", "(", expr, ")"
-        } else {
-            __current_token_index++;
-        }
+        Register result = evaluateTree(value);
+        emit("mov", destination.text, register_names[result]);
+        release(result);
     }
 
-    QString extractCondition(const QList<Lexema>& tokens) {
-        QString condition = "";
-        int paren_count = 1;
-
-        while (__current_token_index < tokens.size() && paren_count > 0) {
-            if (tokens[__current_token_index].value() == "(") {
-                paren_count++;
-            } else if (tokens[__current_token_index].value() == ")") {
-                paren_count--;
-                if (paren_count == 0) {
-                    break;
-                }
-            }
+    /*!
+        An instruction whose left operand is already in the register the
+        result goes to is applied to that register, the way the allocator
+        lets a value take over the register of an operand it outlives.
+        Division needs eax and is left to evaluateTree().
+    */
+    bool generateInPlace(ir::Value value, Register target) {
+        const ir::Opcode op = at(value).op;
+        if (op == ir::Opcode::Neg) {
+            const ir::Value operand = __function->operand(value, 0);
+            if (!isLeaf(operand) || registerOf(operand) != target)
+                return false;
+            emit("neg", register_names[target]);
+            return true;
+        }
+        if (op != ir::Opcode::Add && op != ir::Opcode::Sub && op != ir::Opcode::Mul)
+            return false;
 
-            if (paren_count == 1) {
-                condition += tokens[__current_token_index].value() + " ";
-            }
+        ir::Value left = __function->operand(value, 0);
+        ir::Value right = __function->operand(value, 1);
+        if (isCommutative(op) && isLeaf(right) && registerOf(right) == target)
+            std::swap(left, right);
+        if (!isLeaf(left) || registerOf(left) != target ||
+            (isLeaf(right) && registerOf(right) == target))
+            return false;
 
-            __current_token_index++;
+        if (isLeaf(right)) {
+            applyOperator(op, target, leafOperand(right));
+            return true;
         }
-
-        return condition.trimmed();
+        Register operand = evaluateTree(right);
+        applyOperator(op, target, {register_names[operand], Operand::InRegister, operand});
+        release(operand);
+        return true;
     }
 
-    QString extractExpression(int start_index, const QList<Lexema>& tokens) {
-        QString expr = "";
-        int i = start_index;
-        int paren_count = 0;
+    // Expressions
 
-        while (i < tokens.size()) {
-            QString val = tokens[i].value();
+    quint8 registerBit(Register r) const { return quint8(1u << r); }
 
-            if (val == "(") {
-                paren_count++;
-            } else if (val == ")") {
-                if (paren_count == 0) {
-                    break;
-                }
-                paren_count--;
-            } else if (val == ";" && paren_count == 0) {
-                break;
-            }
-
-            expr += val + " ";
-            i++;
-        }
-
-        return expr.trimmed();
+    int freeRegisters() const {
+        int free = 0;
+        for (int r = 0; r < REGISTERS; r++)
+            if (!(__busy & registerBit(Register(r))))
+                free++;
+        return free;
     }
 
-    void closeCurrentBlock() {
-        // Close loops first
-        if (!__loop_contexts.isEmpty()) {
-            LoopContext context = __loop_contexts.top();
-
-            if (context.is_for_loop && !context.increment_code.isEmpty() && context.increment_code != "1") {
-                // Generate increment code for for-loop
-                __generated_code.append("    ; For loop increment");
-                processAssignmentFromString(context.increment_code);
+    //! Registers free of allocated values are taken before edx, which division needs.
+    Register allocate() {
+        static constexpr Register order[REGISTERS] = {EAX, ECX, EDI, EBP, ESI, EBX, EDX};
+        for (Register r : order)
+            if (!(__busy & registerBit(r))) {
+                __busy |= registerBit(r);
+                return r;
             }
+        // evaluate() spills before it runs out
+        throw std::logic_error("AsmGenerator: out of registers");
+    }
 
-            __generated_code.append("    jmp " + context.condition_label);
-            __generated_code.append(context.end_label + ":");
-            __generated_code.append("    ; Loop end");
-
-            __loop_contexts.pop();
-            __loop_depth--;
-        }
+    void release(Register r) { __busy &= quint8(~registerBit(r)); }
+
+    //! Add and Mul may have their operands swapped.
+    bool isCommutative(ir::Opcode op) const { return op == ir::Opcode::Add || op == ir::Opcode::Mul; }
+
+    /*!
+        The operands of a binary instruction in the order evaluate() takes
+        them: a leaf goes right, where it is used in place, if the
+        operator allows.
+    */
+    std::pair<ir::Value, ir::Value> operandsOf(ir::Value value) const {
+        ir::Value left = __function->operand(value, 0);
+        ir::Value right = __function->operand(value, 1);
+        if (isCommutative(at(value).op) && isLeaf(left) && !isLeaf(right))
+            std::swap(left, right);
+        return {left, right};
+    }
 
-        // Close if statements
-        if (!__if_labels.isEmpty()) {
-            QString end_if_label = __if_labels.pop();
-            __generated_code.append(end_if_label + ":");
-            __generated_code.append("    ; End if/else");
-            __if_depth--;
-        }
+    /*!
+        The Sethi-Ullman number of a tree: the registers it takes to
+        evaluate without spilling. A leaf takes one, a leaf right operand
+        none since it is used in place, and an instruction whose operands
+        take l and r registers takes max(l, r), or l + 1 if they are
+        equal. Computed once per value.
+    */
+    quint8 need(ir::Value value) {
+        if (__need[value])
+            return __need[value];
+
+        quint8 result = 1;
+        switch (at(value).op) {
+        case ir::Opcode::Neg:
+        case ir::Opcode::Copy: {
+            const ir::Value operand = __function->operand(value, 0);
+            result = isLeaf(operand) ? 1 : need(operand);
+            break;
+        }
+        case ir::Opcode::Add:
+        case ir::Opcode::Sub:
+        case ir::Opcode::Mul:
+        case ir::Opcode::Div: {
+            auto [left, right] = operandsOf(value);
+            const int l = isLeaf(left) ? 1 : need(left);
+            const int r = isLeaf(right) ? 0 : need(right);
+            result = (quint8)qMin(l == r ? l + 1 : qMax(l, r), 255);
+            break;
+        }
+        default:
+            break;
+        }
+        return __need[value] = result;
     }
 
-    void closeAllBlocks() {
-        while (!__loop_contexts.isEmpty()) {
-            closeCurrentBlock();
-        }
+    //! Loads a leaf, or computes a folded value, into a register it allocates.
+    Register evaluate(ir::Value value) {
+        if (!isLeaf(value))
+            return evaluateTree(value);
 
-        while (!__if_labels.isEmpty()) {
-            QString end_if_label = __if_labels.pop();
-            __generated_code.append(end_if_label + ":");
-            __generated_code.append("    ; End if/else");
-        }
+        Register result = allocate();
+        emit("mov", register_names[result], leafOperand(value).text);
+        return result;
     }
 
-    void generateInputCode(const QString& var_name) {
-        __generated_code.append("");
-        __generated_code.append(QString("    ; Input to %1").arg(var_name));
-
-        // Simple inline input (without function call for simplicity)
-        __generated_code.append(QString("    mov eax, 3          ; sys_read"));
-        __generated_code.append(QString("    mov ebx, 0          ; stdin"));
-        __generated_code.append(QString("    mov ecx, input_buffer"));
-        __generated_code.append(QString("    mov edx, 12         ; buffer size"));
-        __generated_code.append(QString("    int 0x80"));
-        __generated_code.append(QString("    "));
-        __generated_code.append(QString("    ; Convert string to integer"));
-        __generated_code.append(QString("    mov esi, input_buffer"));
-        __generated_code.append(QString("    xor eax, eax"));
-        __generated_code.append(QString("    xor ebx, ebx"));
-        __generated_code.append(QString("    mov ecx, 10"));
-        __generated_code.append(QString("convert_input:"));
-        __generated_code.append(QString("    mov bl, [esi]"));
-        __generated_code.append(QString("    cmp bl, 0"));
-        __generated_code.append(QString("    je convert_input_done"));
-        __generated_code.append(QString("    cmp bl, 10         ; newline"));
-        __generated_code.append(QString("    je convert_input_done"));
-        __generated_code.append(QString("    sub bl, '0'"));
-        __generated_code.append(QString("    imul eax, ecx"));
-        __generated_code.append(QString("    add eax, ebx"));
-        __generated_code.append(QString("    inc esi"));
-        __generated_code.append(QString("    jmp convert_input"));
-        __generated_code.append(QString("convert_input_done:"));
-        __generated_code.append(QString("    mov [%1], eax").arg(var_name));
-    }
-
-    void generateOutputCode(const QString& expr) {
-        __generated_code.append("");
-        __generated_code.append(QString("    ; Output %1").arg(expr));
-
-        // Evaluate expression
-        generateExpressionCode(expr, "eax");
+    /*!
+        Computes an instruction into a register it allocates, taking the
+        operand that needs more registers first so the other one can use
+        what is left. When the registers free cannot hold both operands the
+        right one is evaluated first and waits on the stack, used in place
+        from there.
+    */
+    Register evaluateTree(ir::Value value) {
+        const ir::Opcode op = at(value).op;
+
+        if (op == ir::Opcode::Copy)
+            return evaluate(__function->operand(value, 0));
+        if (op == ir::Opcode::Neg) {
+            Register result = evaluate(__function->operand(value, 0));
+            emit("neg", register_names[result]);
+            return result;
+        }
+        if (!ir::is_arithmetic(op))
+            throw std::logic_error("AsmGenerator: not an expression");
+
+        auto [left, right] = operandsOf(value);
+
+        if (isLeaf(right)) {
+            Register result = evaluate(left);
+            applyOperator(op, result, leafOperand(right));
+            return result;
+        }
+
+        if (need(value) <= freeRegisters()) {
+            Register result, operand;
+            if ((isLeaf(left) ? 1 : need(left)) >= need(right)) {
+                result = evaluate(left);
+                operand = evaluate(right);
+            }
+            else {
+                operand = evaluate(right);
+                result = evaluate(left);
+            }
+            applyOperator(op, result, {register_names[operand], Operand::InRegister, operand});
+            release(operand);
+            return result;
+        }
 
-        // Convert to string and output
-        __generated_code.append(QString("    ; Convert to string"));
-        __generated_code.append(QString("    mov ebx, 10"));
-        __generated_code.append(QString("    mov ecx, output_buffer"));
-        __generated_code.append(QString("    add ecx, 11"));
-        __generated_code.append(QString("    mov byte [ecx], 0"));
-        __generated_code.append(QString("    dec ecx"));
-        __generated_code.append(QString("    mov byte [ecx], 10  ; newline"));
-        __generated_code.append(QString("    "));
-        __generated_code.append(QString("    cmp eax, 0"));
-        __generated_code.append(QString("    jge output_positive"));
-        __generated_code.append(QString("    neg eax"));
-        __generated_code.append(QString("    mov byte [output_buffer], '-'"));
-        __generated_code.append(QString("output_positive:"));
-        __generated_code.append(QString("output_convert:"));
-        __generated_code.append(QString("    xor edx, edx"));
-        __generated_code.append(QString("    div ebx"));
-        __generated_code.append(QString("    add dl, '0'"));
-        __generated_code.append(QString("    mov [ecx], dl"));
-        __generated_code.append(QString("    dec ecx"));
-        __generated_code.append(QString("    test eax, eax"));
-        __generated_code.append(QString("    jnz output_convert"));
-        __generated_code.append(QString("    "));
-        __generated_code.append(QString("    inc ecx"));
-        __generated_code.append(QString("    mov eax, 4          ; sys_write"));
-        __generated_code.append(QString("    mov ebx, 1          ; stdout"));
-        __generated_code.append(QString("    mov edx, 12"));
-        __generated_code.append(QString("    sub edx, ecx"));
-        __generated_code.append(QString("    add edx, output_buffer"));
-        __generated_code.append(QString("    int 0x80"));
-    }
-
-    void generateAssignmentCode(const QString& var_name, const QString& expr) {
-        __generated_code.append("");
-        __generated_code.append(QString("    ; %1 = %2").arg(var_name, expr));
-
-        generateExpressionCode(expr, "eax");
-        __generated_code.append(QString("    mov [%1], eax").arg(var_name));
-    }
-
-    void generateConditionCode(const QString& condition, const QString& false_label) {
-        __generated_code.append(QString("    ; Condition: %1").arg(condition));
-
-        // Evaluate the condition expression
-        generateExpressionCode(condition, "eax");
+        Register operand = evaluate(right);
+        emit("push", register_names[operand]);
+        release(operand);
 
-        // Check if result is zero (false)
-        __generated_code.append(QString("    cmp eax, 0"));
-        __generated_code.append(QString("    je %1").arg(false_label));
+        Register result = evaluate(left);
+        applyOperator(op, result, {"dword [esp]", Operand::OnStack});
+        emit("add", "esp", "4");
+        return result;
     }
 
-    void generateExpressionCode(const QString& expr, const QString& dest_reg) {
-        QStringList parts = expr.split(" ", Qt::SkipEmptyParts);
-
-        if (parts.size() == 1) {
-            // Single value
-            bool is_number;
-            parts[0].toInt(&is_number);
+    void applyOperator(ir::Opcode op, Register value, const Operand& operand) {
+        const QString target = register_names[value];
+
+        switch (op) {
+        case ir::Opcode::Add:
+            emit("add", target, operand.text);
+            break;
+        case ir::Opcode::Sub:
+            emit("sub", target, operand.text);
+            break;
+        case ir::Opcode::Mul:
+            emit("imul", target, operand.text);
+            break;
+        case ir::Opcode::Div:
+            generateDivision(value, operand);
+            break;
+        default:
+            throw std::logic_error("AsmGenerator: not a binary operator");
+        }
+    }
 
-            if (is_number) {
-                __generated_code.append(QString("    mov %1, %2").arg(dest_reg, parts[0]));
-            } else {
-                __generated_code.append(QString("    mov %1, [%2]").arg(dest_reg, parts[0]));
+    /*!
+        idiv divides edx:eax and takes no immediate: eax and edx are saved
+        if other values live in them, a divisor that is an immediate or in
+        eax or edx is pushed and divided by from the stack.
+    */
+    void generateDivision(Register value, const Operand& divisor) {
+        QList<Register> saved;
+        for (Register r : {EAX, EDX})
+            if (r != value && !(divisor.kind == Operand::InRegister && divisor.reg == r) &&
+                (__busy & registerBit(r))) {
+                emit("push", register_names[r]);
+                saved.append(r);
             }
-        } else {
-            // Complex expression - handle common patterns
-            // For simplicity, handle basic arithmetic
-            QString simplified = expr;
-            simplified = simplified.replace("(", "").replace(")", "");
-            QStringList tokens = simplified.split(" ", Qt::SkipEmptyParts);
-
-            if (tokens.size() >= 3) {
-                QString left = tokens[0];
-                QString op = tokens[1];
-                QString right = tokens[2];
-
-                // Load left operand
-                bool left_is_number;
-                left.toInt(&left_is_number);
-
-                if (left_is_number) {
-                    __generated_code.append(QString("    mov %1, %2").arg(dest_reg, left));
-                } else {
-                    __generated_code.append(QString("    mov %1, [%2]").arg(dest_reg, left));
-                }
 
-                // Handle operation
-                bool right_is_number;
-                right.toInt(&right_is_number);
-
-                if (op == "+") {
-                    if (right_is_number) {
-                        __generated_code.append(QString("    add %1, %2").arg(dest_reg, right));
-                    } else {
-                        __generated_code.append(QString("    add %1, [%2]").arg(dest_reg, right));
-                    }
-                }
-                else if (op == "-") {
-                    if (right_is_number) {
-                        __generated_code.append(QString("    sub %1, %2").arg(dest_reg, right));
-                    } else {
-                        __generated_code.append(QString("    sub %1, [%2]").arg(dest_reg, right));
-                    }
-                }
-                else if (op == "*") {
-                    if (right_is_number) {
-                        __generated_code.append(QString("    imul %1, %2").arg(dest_reg, right));
-                    } else {
-                        __generated_code.append(QString("    imul %1, [%2]").arg(dest_reg, right));
-                    }
-                }
-                else if (op == "/") {
-                    // For a/b, we need to handle division properly
-                    __generated_code.append(QString("    cdq"));
-                    if (right_is_number) {
-                        __generated_code.append(QString("    mov ebx, %1").arg(right));
-                    } else {
-                        __generated_code.append(QString("    mov ebx, [%1]").arg(right));
-                    }
-                    __generated_code.append(QString("    idiv ebx"));
-                    __generated_code.append(QString("    mov %1, eax").arg(dest_reg));
-                }
-            } else {
-                // Simple expression - try to evaluate
-                __generated_code.append(QString("    ; Expression: %1").arg(expr));
-                __generated_code.append(QString("    mov %1, 0  ; placeholder").arg(dest_reg));
-            }
-        }
+        QString by = "dword " + divisor.text;
+        bool pushed = false;
+        if (divisor.kind == Operand::Immediate ||
+            (divisor.kind == Operand::InRegister && (divisor.reg == EAX || divisor.reg == EDX))) {
+            emit("push", QString("dword %1").arg(divisor.text));
+            by = "dword [esp]";
+            pushed = true;
+        }
+        else if (divisor.kind == Operand::InRegister)
+            by = divisor.text;
+        else if (divisor.kind == Operand::OnStack)
+            by = saved.isEmpty() ? divisor.text : QString("dword [esp + %1]").arg(4 * saved.size());
+
+        if (value != EAX)
+            emit("mov", "eax", register_names[value]);
+        emit("cdq");
+        emit("idiv", by);
+        if (pushed)
+            emit("add", "esp", "4");
+        if (value != EAX)
+            emit("mov", register_names[value], "eax");
+
+        for (qsizetype i = saved.size() - 1; i >= 0; i--)
+            emit("pop", register_names[saved.at(i)]);
     }
 
     void generateHelperFunctions() {
         // Add .bss section for buffers
-        __generated_code.append("");
-        __generated_code.append("section .bss");
-        __generated_code.append("    input_buffer resb 12");
-        __generated_code.append("    output_buffer resb 12");
-
-        // Declare all variables
-        for (const QString& var : __declared_variables) {
-            __generated_code.append(QString("    %1 resd 1").arg(var));
-        }
+        emitBlank();
+        emitDirective("section .bss");
+        emitDirective("    input_buffer resb 12");
+        emitDirective("    output_buffer resb 12");
+
+        // Declare all variables, laid out in the order their names were first seen
+        QList<VariableTable::Variable*> variables;
+        variables.reserve(__variables->size());
+        __variables->for_each([&](VariableTable::Variable& variable) {
+            variables.append(&variable);
+        });
+        std::sort(variables.begin(), variables.end(),
+                  [](const VariableTable::Variable* a, const VariableTable::Variable* b) {
+                      return a->symbol < b->symbol;
+                  });
+
+        qint32 offset = 0;
+        for (VariableTable::Variable* variable : variables) {
+            variable->storage.offset = offset;
+            offset += variable->storage.size;
+            emitDirective(QString("    %1 resd %2")
+                .arg(__lexer->get_ids().value(variable->symbol))
+                .arg(variable->storage.size / 4));
+        }
+
+        // Then the values that are not a version of any variable
+        for (qint32 temp = 0; temp < __temp_count; temp++)
+            emitDirective(QString("    __t%1 resd 1").arg(temp));
     }
 
     bool writeToFile(const QString& filename) {
@@ -718,8 +814,8 @@ private:
         }
 
         QTextStream out(&file);
-        for (const auto& line : __generated_code) {
-            out << line << "\n";
+        for (const AsmLine& line : __generated_code) {
+            out << line.toString() << "\n";
         }
 
         file.close();
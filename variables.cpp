@@ -0,0 +1,141 @@
+#include "variables.h"
+
+namespace {
+
+// Fibonacci hashing: symbol ids are dense, the multiplication spreads them.
+inline qsizetype home_slot(qint32 symbol, qsizetype mask) {
+    return (qsizetype)(((quint64)(quint32)symbol * 0x9E3779B97F4A7C15ull) >> 32) & mask;
+}
+
+} // namespace
+
+void VariableTable::clear() {
+    for (Variable& variable : __slots)
+        variable = Variable();
+    __undo.clear();
+    __scopes.clear();
+    __size = 0;
+}
+
+/*!
+    Makes room for variables without growing, with the table at most half
+    full.
+*/
+void VariableTable::reserve(qsizetype variables) {
+    qsizetype capacity = 16;
+    while (capacity < 2 * variables)
+        capacity *= 2;
+    if (capacity <= (qsizetype)__slots.size())
+        return;
+
+    std::vector<Variable> old;
+    old.swap(__slots);
+    __slots.assign(capacity, Variable());
+
+    const qsizetype mask = capacity - 1;
+    for (const Variable& variable : old) {
+        if (variable.symbol < 0)
+            continue;
+        qsizetype slot = home_slot(variable.symbol, mask);
+        while (__slots[slot].symbol >= 0)
+            slot = (slot + 1) & mask;
+        __slots[slot] = variable;
+    }
+}
+
+void VariableTable::grow() {
+    reserve(qMax<qsizetype>(__size + 1, (qsizetype)__slots.size()));
+}
+
+/*!
+    Index of the slot holding symbol, or of the free slot it would go to.
+*/
+qsizetype VariableTable::slot_of(qint32 symbol) const {
+    const qsizetype mask = (qsizetype)__slots.size() - 1;
+    qsizetype slot = home_slot(symbol, mask);
+    while (__slots[slot].symbol >= 0 && __slots[slot].symbol != symbol)
+        slot = (slot + 1) & mask;
+    return slot;
+}
+
+/*!
+    Frees the slot and moves later entries of its probe run back, so no
+    lookup ever has to step over a hole.
+*/
+void VariableTable::erase(qsizetype slot) {
+    const qsizetype mask = (qsizetype)__slots.size() - 1;
+    qsizetype hole = slot;
+
+    for (qsizetype next = (hole + 1) & mask; __slots[next].symbol >= 0; next = (next + 1) & mask) {
+        qsizetype home = home_slot(__slots[next].symbol, mask);
+        // Move the entry into the hole unless its home lies after the hole.
+        if (((next - home) & mask) >= ((next - hole) & mask)) {
+            __slots[hole] = __slots[next];
+            hole = next;
+        }
+    }
+    __slots[hole] = Variable();
+    __size--;
+}
+
+void VariableTable::enter_scope() {
+    __scopes.push_back((qsizetype)__undo.size());
+}
+
+/*!
+    Undoes the declarations of the innermost scope, latest first.
+*/
+void VariableTable::leave_scope() {
+    if (__scopes.empty())
+        return;
+
+    const qsizetype mark = __scopes.back();
+    __scopes.pop_back();
+
+    while ((qsizetype)__undo.size() > mark) {
+        const Undo& undo = __undo.back();
+        qsizetype slot = slot_of(undo.symbol);
+
+        if (undo.previous.symbol >= 0)
+            __slots[slot] = undo.previous;
+        else
+            erase(slot);
+        __undo.pop_back();
+    }
+}
+
+VariableTable::Variable* VariableTable::declare(qint32 symbol) {
+    if (2 * (__size + 1) > (qsizetype)__slots.size())
+        grow();
+
+    qsizetype slot = slot_of(symbol);
+    Variable& variable = __slots[slot];
+    const qint32 scope = (qint32)depth();
+
+    if (variable.symbol >= 0 && variable.scope == scope)
+        return nullptr;
+
+    if (!__scopes.empty())
+        __undo.push_back({symbol, variable});
+    if (variable.symbol < 0)
+        __size++;
+
+    variable = Variable();
+    variable.symbol = symbol;
+    variable.scope = scope;
+    return &variable;
+}
+
+VariableTable::Variable* VariableTable::find(qint32 symbol) {
+    if (__slots.empty())
+        return nullptr;
+    Variable& variable = __slots[slot_of(symbol)];
+    return variable.symbol >= 0 ? &variable : nullptr;
+}
+
+const VariableTable::Variable* VariableTable::find(qint32 symbol) const {
+    if (__slots.empty())
+        return nullptr;
+    const Variable& variable = __slots[slot_of(symbol)];
+    return variable.symbol >= 0 ? &variable : nullptr;
+}
@@ -0,0 +1,76 @@
+#ifndef VARIABLES_H
+#define VARIABLES_H
+
+#include <QtGlobal>
+
+#include <vector>
+
+/*!
+    Where the code generator keeps a variable. Filled in by the generator;
+    the semantic analyzer only declares the variable.
+*/
+struct VariableStorage {
+    quint32 size = 4;       // bytes
+    qint32 offset = -1;     // from the start of the variables, -1 if not laid out
+};
+
+/*!
+    Variables in scope, keyed on the symbol id the lexer interned their
+    name under. A flat open-addressing hash with linear probing; the
+    scopes are a stack over an undo log that records what every
+    declaration replaced, so leaving a scope costs as much as the
+    declarations made in it. Declaring a variable in an inner scope
+    shadows the outer one until the inner scope is left.
+*/
+class VariableTable {
+public:
+    struct Variable {
+        qint32 symbol = -1;     // -1 for a free slot
+        qint32 scope = 0;       // depth of the scope that declared it
+        VariableStorage storage;
+    };
+
+private:
+    struct Undo {
+        qint32 symbol;
+        Variable previous;      // previous.symbol is -1 if nothing was shadowed
+    };
+
+    std::vector<Variable> __slots;
+    std::vector<Undo> __undo;
+    std::vector<qsizetype> __scopes;    // undo log size when each scope was entered
+    qsizetype __size = 0;
+
+    qsizetype slot_of(qint32 symbol) const;
+    void grow();
+    void erase(qsizetype slot);
+
+public:
+    VariableTable() = default;
+
+    void clear();
+    void reserve(qsizetype variables);
+
+    void enter_scope();
+    void leave_scope();
+    qsizetype depth() const { return (qsizetype)__scopes.size(); }
+
+    //! nullptr if the symbol is already declared in the current scope.
+    Variable* declare(qint32 symbol);
+
+    Variable* find(qint32 symbol);
+    const Variable* find(qint32 symbol) const;
+    bool contains(qint32 symbol) const { return find(symbol) != nullptr; }
+
+    qsizetype size() const { return __size; }
+
+    //! Calls f(variable) for every variable in scope, in no particular order.
+    template <typename F>
+    void for_each(F f) {
+        for (Variable& variable : __slots)
+            if (variable.symbol >= 0)
+                f(variable);
+    }
+};
+
+#endif // VARIABLES_H